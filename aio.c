@@ -0,0 +1,344 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "aio.h"
+
+//------------------------------------------------------------------------------
+
+// The ring is driven directly by system call, as the kernel documents it, with
+// submission and completion queues shared with the kernel through mappings.
+// Each request in flight holds a slot giving what remains of its transfer, so
+// that a short transfer may be resubmitted for the rest.
+
+struct aioreq
+{
+    struct iovec v;   // buffer remaining
+    off_t        o;   // file offset remaining
+    int          f;   // file descriptor
+    int          g;   // group
+    bool         out; // write?
+};
+
+struct aio
+{
+    int      f;                 // ring descriptor, or -1 if none
+    unsigned n;                 // requests in flight
+    unsigned u;                 // requests queued but not yet submitted
+    unsigned c[AIO_GROUPS];     // requests in flight by group
+    bool     e[AIO_GROUPS];     // group has failed
+    int      s[AIO_DEPTH];      // free slots
+    unsigned k;                 // free slot count
+
+    struct aioreq r[AIO_DEPTH]; // slots
+
+    unsigned *sqhead;
+    unsigned *sqtail;
+    unsigned *sqmask;
+    unsigned *sqarray;
+    unsigned *cqhead;
+    unsigned *cqtail;
+    unsigned *cqmask;
+
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    void  *sq;
+    void  *cq;
+    size_t sqlen;
+    size_t cqlen;
+    size_t sqeslen;
+};
+
+static bool xfer(int f, char *buf, size_t len, off_t o, bool out)
+{
+    while (len > 0)
+    {
+        ssize_t n = out ? pwrite(f, buf, len, o)
+                        : pread (f, buf, len, o);
+        if (n > 0)
+        {
+            buf += n;
+            len -= n;
+            o   += n;
+        }
+        else return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+static void ringunmap(struct aio *q)
+{
+    if (q->sqes)                 munmap(q->sqes, q->sqeslen);
+    if (q->cq && q->cq != q->sq) munmap(q->cq,   q->cqlen);
+    if (q->sq)                   munmap(q->sq,   q->sqlen);
+}
+
+// Map the queues of a new ring and locate their fields.
+
+static bool ringmap(struct aio *q, const struct io_uring_params *p)
+{
+    const bool single = (p->features & IORING_FEAT_SINGLE_MMAP);
+
+    q->sqlen   = p->sq_off.array + p->sq_entries * sizeof (unsigned);
+    q->cqlen   = p->cq_off.cqes  + p->cq_entries * sizeof (struct io_uring_cqe);
+    q->sqeslen = p->sq_entries * sizeof (struct io_uring_sqe);
+
+    if (single)
+        q->sqlen = q->cqlen = (q->sqlen > q->cqlen) ? q->sqlen : q->cqlen;
+
+    if ((q->sq = mmap(0, q->sqlen, PROT_READ | PROT_WRITE, MAP_SHARED
+                      | MAP_POPULATE, q->f, IORING_OFF_SQ_RING)) == MAP_FAILED)
+        q->sq = NULL;
+
+    else if ((q->cq = single ? q->sq
+                    : mmap(0, q->cqlen, PROT_READ | PROT_WRITE, MAP_SHARED
+                      | MAP_POPULATE, q->f, IORING_OFF_CQ_RING)) == MAP_FAILED)
+        q->cq = NULL;
+
+    else if ((q->sqes = mmap(0, q->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED
+                      | MAP_POPULATE, q->f, IORING_OFF_SQES)) == MAP_FAILED)
+        q->sqes = NULL;
+
+    else
+    {
+        q->sqhead  = (unsigned *) ((char *) q->sq + p->sq_off.head);
+        q->sqtail  = (unsigned *) ((char *) q->sq + p->sq_off.tail);
+        q->sqmask  = (unsigned *) ((char *) q->sq + p->sq_off.ring_mask);
+        q->sqarray = (unsigned *) ((char *) q->sq + p->sq_off.array);
+        q->cqhead  = (unsigned *) ((char *) q->cq + p->cq_off.head);
+        q->cqtail  = (unsigned *) ((char *) q->cq + p->cq_off.tail);
+        q->cqmask  = (unsigned *) ((char *) q->cq + p->cq_off.ring_mask);
+        q->cqes    = (struct io_uring_cqe *) ((char *) q->cq + p->cq_off.cqes);
+        return true;
+    }
+    ringunmap(q);
+    return false;
+}
+
+// Queue the request in slot i for submission.
+
+static void post(struct aio *q, int i)
+{
+    const struct aioreq *r = q->r + i;
+    const unsigned       t = *q->sqtail;
+    const unsigned       j = t & *q->sqmask;
+    struct io_uring_sqe *s = q->sqes + j;
+
+    memset(s, 0, sizeof (struct io_uring_sqe));
+
+    s->opcode    = r->out ? IORING_OP_WRITEV : IORING_OP_READV;
+    s->fd        = r->f;
+    s->addr      = (unsigned long) &r->v;
+    s->len       = 1;
+    s->off       = (unsigned long long) r->o;
+    s->user_data = (unsigned long long) i;
+
+    q->sqarray[j] = j;
+    __atomic_store_n(q->sqtail, t + 1, __ATOMIC_RELEASE);
+    q->u++;
+}
+
+// Submit the queued requests and gather those completed, first waiting for at
+// least one if asked. Queue the rest of any short or interrupted transfer
+// again. A failure marks the group of the request, and leaves its cause in
+// errno.
+
+static bool reap(struct aio *q, bool wait)
+{
+    unsigned h;
+    unsigned t;
+    int      k;
+
+    do
+        k = (int) syscall(__NR_io_uring_enter, q->f, q->u, wait ? 1 : 0,
+                                wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    while (k < 0 && errno == EINTR);
+
+    if (k < 0)
+        return false;
+
+    q->u -= (unsigned) k;
+
+    h = *q->cqhead;
+    t = __atomic_load_n(q->cqtail, __ATOMIC_ACQUIRE);
+
+    for (; h != t; h++)
+    {
+        const struct io_uring_cqe *c = q->cqes + (h & *q->cqmask);
+        const int                  i = (int) c->user_data;
+        struct aioreq             *r = q->r + i;
+
+        if (c->res > 0 && (size_t) c->res < r->v.iov_len)
+        {
+            r->v.iov_base = (char *) r->v.iov_base + c->res;
+            r->v.iov_len -= c->res;
+            r->o         += c->res;
+            post(q, i);
+        }
+        else if (c->res == -EAGAIN || c->res == -EINTR)
+            post(q, i);
+        else
+        {
+            if (c->res <= 0)
+            {
+                errno      = c->res ? -c->res : EIO;
+                q->e[r->g] = true;
+            }
+
+            q->c[r->g]--;
+            q->n--;
+            q->s[q->k++] = i;
+        }
+    }
+    __atomic_store_n(q->cqhead, h, __ATOMIC_RELEASE);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Open a new queue, with a ring if the kernel allows one.
+
+struct aio *aioopen(void)
+{
+    struct io_uring_params p;
+    struct aio            *q;
+
+    if ((q = (struct aio *) calloc(1, sizeof (struct aio))))
+    {
+        memset(&p, 0, sizeof (p));
+
+        for (int i = 0; i < AIO_DEPTH; i++)
+            q->s[i] = i;
+
+        q->k = AIO_DEPTH;
+
+        if ((q->f = (int) syscall(__NR_io_uring_setup, AIO_DEPTH, &p)) >= 0
+                                                 && !ringmap(q, &p))
+        {
+            close(q->f);
+            q->f = -1;
+        }
+    }
+    return q;
+}
+
+// Determine whether the queue transfers asynchronously.
+
+bool aioasync(const struct aio *q)
+{
+    return (q->f >= 0);
+}
+
+// Begin the transfer of len bytes between buffer and file f at offset o, in
+// group g, and submit it at once. Wait for room in the queue as needed.
+
+bool aioxfer(struct aio *q, int g, int f, void *buf, size_t len,
+                                                    off_t o, bool out)
+{
+    char *b = (char *) buf;
+
+    if (q->f < 0)
+    {
+        if (xfer(f, b, len, o, out))
+            return true;
+
+        q->e[g] = true;
+        return false;
+    }
+
+    while (len > 0)
+    {
+        const size_t c = (len < AIO_PIECE) ? len : AIO_PIECE;
+        int          i;
+
+        while (q->k == 0)
+            if (!reap(q, true))
+            {
+                q->e[g] = true;
+                return false;
+            }
+
+        i = q->s[--q->k];
+
+        q->r[i].v.iov_base = b;
+        q->r[i].v.iov_len  = c;
+        q->r[i].o          = o;
+        q->r[i].f          = f;
+        q->r[i].g          = g;
+        q->r[i].out        = out;
+
+        post(q, i);
+
+        q->c[g]++;
+        q->n++;
+
+        b   += c;
+        o   += c;
+        len -= c;
+    }
+
+    if (reap(q, false))
+        return true;
+
+    q->e[g] = true;
+    return false;
+}
+
+// Wait for every transfer of group g to complete, and report whether all did
+// so successfully since the group was last awaited.
+
+bool aiowait(struct aio *q, int g)
+{
+    bool ok;
+
+    while (q->c[g] > 0)
+        if (!reap(q, true))
+            break;
+
+    ok = (q->c[g] == 0 && !q->e[g]);
+
+    q->e[g] = false;
+    return ok;
+}
+
+// Wait for every transfer and release the queue.
+
+void aioclose(struct aio *q)
+{
+    if (q)
+    {
+        if (q->f >= 0)
+        {
+            for (int g = 0; g < AIO_GROUPS; g++)
+                aiowait(q, g);
+
+            ringunmap(q);
+            close(q->f);
+        }
+        free(q);
+    }
+}
+
+//------------------------------------------------------------------------------
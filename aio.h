@@ -0,0 +1,45 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_AIO_H
+#define GIGO_AIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+//------------------------------------------------------------------------------
+
+// An I/O queue keeps many reads and writes in flight at once through io_uring,
+// so that a device is given the queue depth it needs to reach its bandwidth.
+// Each transfer is split into pieces of at most AIO_PIECE bytes, of which up to
+// AIO_DEPTH are in flight, and is counted in one of AIO_GROUPS groups, each of
+// which may be awaited separately. Where the kernel offers no io_uring, each
+// transfer is done at once with pread or pwrite. A queue belongs to a single
+// thread, and the buffers of its transfers must be left alone until awaited.
+
+#define AIO_DEPTH  64
+#define AIO_PIECE  (1 << 20)
+#define AIO_GROUPS 16
+
+struct aio;
+
+struct aio *aioopen (void);
+bool        aioasync(const struct aio *q);
+bool        aioxfer (struct aio *q, int g, int f, void *buf, size_t len,
+                                                     off_t o, bool out);
+bool        aiowait (struct aio *q, int g);
+void        aioclose(struct aio *q);
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -20,7 +20,7 @@
 #include "img.h"
 #include "err.h"
 #include "etc.h"
-#include "fft.h"
+#include "vec.h"
 
 //------------------------------------------------------------------------------
 
@@ -44,26 +44,22 @@ static float range1 =  FLT_MAX;
 
 static void op_add(float complex *d, float complex *s, size_t n)
 {
-    for (size_t i = 0; i < n; i++)
-        d[i] += s[i];
+    vecadd(d, s, n);
 }
 
 static void op_sub(float complex *d, float complex *s, size_t n)
 {
-    for (size_t i = 0; i < n; i++)
-        d[i] -= s[i];
+    vecsub(d, s, n);
 }
 
 static void op_mul(float complex *d, float complex *s, size_t n)
 {
-    for (size_t i = 0; i < n; i++)
-        d[i] *= s[i];
+    vecmul(d, s, n);
 }
 
 static void op_div(float complex *d, float complex *s, size_t n)
 {
-    for (size_t i = 0; i < n; i++)
-        d[i] /= s[i];
+    vecdiv(d, s, n);
 }
 
 static void op_pow(float complex *d, float complex *s, size_t n)
@@ -97,19 +93,12 @@ static void op_interp(float complex *d, float complex *s, size_t n)
 
 static void op_wiener(float complex *d, float complex *s, size_t n)
 {
-    for (size_t i = 0; i < n; i++)
-    {
-        const float m = cabs(s[i]);
-
-        d[i] = (d[i] * (m * m))
-             / (s[i] * (m * m + wiener));
-     }
+    vecwiener(d, s, n, wiener);
 }
 
 static void op_scale(float complex *d, size_t n)
 {
-    for (size_t i = 0; i < n; i++)
-        d[i] *= scalar;
+    vecscale(d, scalar, n);
 }
 
 static void op_range(float complex *d, size_t n)
@@ -145,66 +134,206 @@ static void op_test(float complex *d, size_t n)
 
 //------------------------------------------------------------------------------
 
-static bool calc1(img *d, int op)
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_thread_num()  { return 0; }
+static inline int omp_get_num_threads() { return 1; }
+#endif
+
+// Tiles move by explicit I/O through the queue of each thread rather than by
+// faulting the mapping. Each thread works a contiguous run of rows of tiles in
+// chunks of up to CHUNK bytes of one row each, going round a ring of Q chunk
+// buffers, each with an I/O group of its own. Q - 2 chunks are read ahead while
+// one is worked, and the last is written behind, so that every thread keeps
+// many transfers in flight.
+
+#define CHUNK (2 << 20)
+#define RING  (16 << 20)
+
+struct sweep
 {
-    const size_t n = (size_t) d->s * d->s * d->p;
+    img   *d;  // image, or null
+    int    n;  // tiles per chunk
+    int    K;  // chunks per row of tiles
+    int    Q;  // chunks in the ring
+    size_t b;  // bytes per chunk
+    char  *a;  // ring of chunk buffers
+};
+
+// Size the chunks of image d, with room for Q in a ring at a. Given image s to
+// be swept alongside, size them by the larger of the two samples, so that the
+// chunks of both cover the same tiles and the rings are of equal length.
+
+static void sweepinit(struct sweep *w, img *d, img *s)
+{
+    const size_t k = (s && imgsize(s->k) > imgsize(d->k)) ? imgsize(s->k)
+                                                          : imgsize(d->k);
+    const size_t t = k * d->t;
+
+    w->d = d;
+    w->n = (int) ((CHUNK < t) ? 1 : ((size_t) d->w < CHUNK / t) ? d->w
+                                                                : CHUNK / t);
+    w->K = (d->w + w->n - 1) / w->n;
+    w->b = imgsize(d->k) * d->t * w->n;
+    w->Q = (int) ((RING / (t * w->n) < 3) ? 3 : (RING / (t * w->n) > 8) ? 8
+                                              : RING / (t * w->n));
+}
+
+// Begin to read or write chunk j of the run of rows beginning at row y.
 
-    float complex *D;
+static bool sweepio(struct sweep *w, int y, int j, bool out)
+{
+    const int r = y + j / w->K;
+    const int c = w->n * (j % w->K);
+    const int q = j % w->Q;
 
-    int y;
-    int x;
+    return imgpost(w->d, r, c, 1, min(w->n, w->d->w - c), w->a + w->b * q,
+                   out, q + 1);
+}
 
-    #pragma omp parallel for private(x, D)
-    for     (y = 0; y < d->h; y++)
-        for (x = 0; x < d->w; x++)
-        {
-            D = imgz(d, y * d->s, x * d->s);
+// Present chunk j of image w as image e of one row of tiles.
 
-            switch (op)
-            {
-                case 's': op_scale(D, n); break;
-                case 'r': op_range(D, n); break;
-                case 'R': op_range(D, n); break;
-                case 'I': op_inv  (D, n); break;
-                case 'E': op_exp  (D, n); break;
-                case 'L': op_log  (D, n); break;
-                case 'N': op_test (D, n); break;
-            }
-        }
-    return true;
+static void sweepget(struct sweep *w, img *e, int j)
+{
+    *e   = *w->d;
+    e->a = w->a + w->b * (j % w->Q);
+    e->h = 1;
+    e->w = min(w->n, w->d->w - w->n * (j % w->K));
 }
 
-static bool calc2(img *d, img *s, int op)
+// Wait for every group of the ring.
+
+static bool sweepend(int Q, bool ok)
+{
+    for (int q = 0; q < Q; q++)
+        ok = imgwait(q + 1) && ok;
+    return ok;
+}
+
+// Apply an operation to the n samples of tile D, given tile S for a binary
+// operation.
+
+static void apply(float complex *D, float complex *S, size_t n, int op)
+{
+    switch (op)
+    {
+        case 's': op_scale (D,    n); break;
+        case 'r': op_range (D,    n); break;
+        case 'R': op_range (D,    n); break;
+        case 'I': op_inv   (D,    n); break;
+        case 'E': op_exp   (D,    n); break;
+        case 'L': op_log   (D,    n); break;
+        case 'N': op_test  (D,    n); break;
+        case 'A': op_add   (D, S, n); break;
+        case 'S': op_sub   (D, S, n); break;
+        case 'M': op_mul   (D, S, n); break;
+        case 'D': op_div   (D, S, n); break;
+        case 'P': op_pow   (D, S, n); break;
+        case 'x': op_min   (D, S, n); break;
+        case 'X': op_max   (D, S, n); break;
+        case 'i': op_interp(D, S, n); break;
+        case 'w': op_wiener(D, S, n); break;
+    }
+}
+
+// Apply an operation to each tile of image d, given image s for a binary
+// operation. Tiles of narrow images are widened into a per-thread buffer, local
+// to its thread, and narrowed again afterward. Each tile is tallied as
+// narrowed, keeping the index current.
+
+static bool calc(img *d, img *s, int op)
 {
     const size_t n = (size_t) d->s * d->s * d->p;
 
-    float complex *D;
-    float complex *S;
+    struct sweep u;
+    struct sweep v;
+
+    size_t  z;
+    char  **a;
+    long    e = 0;
+
+    sweepinit(&u, d, s);
+    sweepinit(&v, s ? s : d, d);
+
+    z = sizeof (float complex) * n * 2 + u.b * u.Q + (s ? v.b * v.Q : 0);
+
+    if (!(a = (char **) imgallocs(z)))
+    {
+        syserr("Failed to allocate tile buffers");
+        return false;
+    }
+
+    #pragma omp parallel reduction(+:e)
+    {
+        const int T = omp_get_num_threads();
+        const int i = omp_get_thread_num();
+        const int y = (int) ((long) d->h *  i      / T);
+        const int J = (int) ((long) d->h * (i + 1) / T - y) * u.K;
+
+        struct sweep U = u;
+        struct sweep V = v;
+
+        float complex *A = (float complex *) a[i];
+        float complex *D;
+        float complex *S = NULL;
+
+        bool ok = true;
+        int  j;
+        int  k;
 
-    int y;
-    int x;
+        U.a = a[i] + sizeof (float complex) * n * 2;
+        V.a = U.a  + U.b * U.Q;
 
-    #pragma omp parallel for private(x, D, S)
-    for     (y = 0; y < d->h; y++)
-        for (x = 0; x < d->w; x++)
+        // Read the first chunks ahead, and then work each chunk in turn,
+        // reading ahead into the buffer of the chunk written two before.
+
+        for (j = 0; ok && j < J && j < U.Q - 2; j++)
+            ok = sweepio(&U, y, j, false) && (!s || sweepio(&V, y, j, false));
+
+        for (j = 0; ok && j < J; j++)
         {
-            D = imgz(d, y * d->s, x * d->s);
-            S = imgz(s, y * d->s, x * d->s);
+            const int q = j + U.Q - 2;
+            const int r = y + j / U.K;
+            const int c = U.n * (j % U.K);
+
+            img E;
+            img F;
+
+            if (!(ok = imgwait(j % U.Q + 1)))
+                break;
+
+            if (q < J && !(ok = imgwait(q % U.Q + 1)
+                             && sweepio(&U, y, q, false)
+                             && (!s || sweepio(&V, y, q, false))))
+                break;
+
+            sweepget(&U, &E, j);
+
+            if (s)
+                sweepget(&V, &F, j);
 
-            switch (op)
+            for (k = 0; k < E.w; k++)
             {
-                case 'A': op_add   (D, S, n); break;
-                case 'S': op_sub   (D, S, n); break;
-                case 'M': op_mul   (D, S, n); break;
-                case 'D': op_div   (D, S, n); break;
-                case 'P': op_pow   (D, S, n); break;
-                case 'x': op_min   (D, S, n); break;
-                case 'X': op_max   (D, S, n); break;
-                case 'i': op_interp(D, S, n); break;
-                case 'w': op_wiener(D, S, n); break;
+                D = imgwiden(&E, 0, k, A);
+
+                if (s)
+                    S = imgwiden(&F, 0, k, A + n);
+
+                apply(D, S, n, op);
+
+                imgnarrow(&E, 0, k, D);
+                imgtally ( d, r, c + k, imgwiden(&E, 0, k, D));
             }
+
+            ok = sweepio(&U, y, j, true);
         }
-    return true;
+        if (!sweepend(U.Q, ok))
+            e++;
+    }
+
+    imgfrees((void **) a, z);
+    return (e == 0);
 }
 
 //------------------------------------------------------------------------------
@@ -218,7 +347,8 @@ static bool proc1(const char *dst, int l, int n, int m, int p, int op)
     {
         if ((d = imgopen(dst, l, n, m, p)))
         {
-            ok = calc1(d, op);
+            imghint(d, IMG_SEQUENTIAL);
+            ok = calc(d, NULL, op);
             imgclose(d);
         }
     }
@@ -239,7 +369,15 @@ static bool proc2(const char *dst,
         {
             if ((s = imgopen(src, l, n, m, p)))
             {
-                ok = calc2(d, s, op);
+                if (imglayout(s) == imglayout(d))
+                {
+                    imghint(d, IMG_SEQUENTIAL);
+                    imghint(s, IMG_SEQUENTIAL);
+                    imgkeep(s);
+                    ok = calc(d, s, op);
+                }
+                else apperr("Tile layouts of %s and %s differ", dst, src);
+
                 imgclose(s);
             }
             imgclose(d);
@@ -283,7 +421,7 @@ int main(int argc, char **argv)
     bool t  = false;
     int  op = 0;
     int  c  = 0;
-    int  l  = 5;
+    int  l  = -1;
     int  n  = 0;
     int  m  = 0;
     int  p  = 0;
@@ -295,8 +433,8 @@ int main(int argc, char **argv)
         switch (o)
         {
             case 'l': l = (int) strtol(optarg, 0, 0); break;
-            case 'n': n = (int) strtol(optarg, 0, 0); break;
-            case 'm': m = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = (int) strtol(optarg, 0, 0); break;
 
             case 'A': op = o; c = 2; break;
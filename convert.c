@@ -16,9 +16,11 @@
 #include <stdio.h>
 
 #include "img.h"
+#include "wis.h"
 #include "err.h"
 #include "etc.h"
 #include "icc.h"
+#include "zip.h"
 
 //------------------------------------------------------------------------------
 
@@ -36,9 +38,9 @@ static bool istif(const char *arg)
 
 static TIFF *tifopenr(const char *tif,  // TIFF file name
                             bool *c,    // return is complex?
-                             int *l,    // return log2 tile size
-                             int *n,    // return log2 height
-                             int *m,    // return log2 width
+                             int *k,    // return tile size
+                             int *n,    // return height
+                             int *m,    // return width
                              int *p)    // return pixel size
 {
     TIFF *T;
@@ -67,17 +69,13 @@ static TIFF *tifopenr(const char *tif,  // TIFF file name
             {
                 if (B == 32)
                 {
-                    if (ispow2(W) && ispow2(L))
-                    {
-                        *c = (P % 2) ? false : true;
-                        *p = (P % 2) ? P     : P / 2;
-                        *l = log2i(S);
-                        *n = log2i(L);
-                        *m = log2i(W);
+                    *c = (P % 2) ? false : true;
+                    *p = (P % 2) ? P     : P / 2;
+                    *k = (int) S;
+                    *n = (int) L;
+                    *m = (int) W;
 
-                        return T;
-                    }
-                    else apperr("TIFF image size must be power of 2");
+                    return T;
                 }
                 else apperr("TIFF must have 32 bits per sample");
             }
@@ -93,16 +91,16 @@ static TIFF *tifopenr(const char *tif,  // TIFF file name
 
 static TIFF *tifopenw(const char *tif,  // TIFF file name
                              bool c,    // is complex?
-                              int n,    // log2 height
-                              int m,    // log2 width
+                              int n,    // height
+                              int m,    // width
                               int p)    // pixel size
 {
     TIFF *T;
 
     if ((T = TIFFOpen(tif, "w")))
     {
-        TIFFSetField(T, TIFFTAG_IMAGEWIDTH,      1 << m);
-        TIFFSetField(T, TIFFTAG_IMAGELENGTH,     1 << n);
+        TIFFSetField(T, TIFFTAG_IMAGEWIDTH,      m);
+        TIFFSetField(T, TIFFTAG_IMAGELENGTH,     n);
         TIFFSetField(T, TIFFTAG_SAMPLESPERPIXEL, c ? 2 * p : p);
         TIFFSetField(T, TIFFTAG_BITSPERSAMPLE,   32);
         TIFFSetField(T, TIFFTAG_SAMPLEFORMAT,    SAMPLEFORMAT_IEEEFP);
@@ -125,57 +123,74 @@ static TIFF *tifopenw(const char *tif,  // TIFF file name
 
 //------------------------------------------------------------------------------
 
-static inline void ctor(float *dst, const float complex *src, int c)
+// Convert the samples of the pixel at offset o of image d to and from real
+// values or polar pairs, in the image's sample format.
+
+static inline void ctor(float *dst, img *d, size_t o)
 {
-    for (int k = 0; k < c; k++)
-        dst[k    ] = cabsf(src[k]);
+    for (int k = 0; k < d->p; k++)
+        dst[k] = cabsf(imgval(d, imgco(d, o, k)));
 }
 
-static inline void ctop(float *dst, const float complex *src, int c)
+static inline void ctop(float *dst, img *d, size_t o)
 {
-    for (int k = 0; k < c; k++)
+    for (int k = 0; k < d->p; k++)
     {
-        dst[k    ] = cabsf(src[k]);
-        dst[k + c] = cargf(src[k]);
+        const float complex z = imgval(d, imgco(d, o, k));
+
+        dst[k       ] = cabsf(z);
+        dst[k + d->p] = cargf(z);
     }
 }
 
-static inline void rtoc(float complex *dst, const float *src, int c)
+static inline void rtoc(img *d, size_t o, const float *src)
 {
-    for (int k = 0; k < c; k++)
-        dst[k] = src[k];
+    for (int k = 0; k < d->p; k++)
+        imgset(d, imgco(d, o, k), src[k]);
 }
 
-static inline void ptoc(float complex *dst, const float *src, int c)
+static inline void ptoc(img *d, size_t o, const float *src)
 {
-    for (int k = 0; k < c; k++)
-        dst[k] = src[k] * cisf(src[k + c]);
+    for (int k = 0; k < d->p; k++)
+        imgset(d, imgco(d, o, k), src[k] * cisf(src[k + d->p]));
 }
 
 //------------------------------------------------------------------------------
 
-// Copy one tile of real TIFF data into a complex image cache.
+// Copy one tile of real TIFF data into a complex image cache, clipping it to
+// the bounds of the source image. If extending, copy each pixel to its image
+// in the rotated copy too.
 
 static void tiletoimgr(int y,  // destination row
                        int x,  // destination column
                       img *d,  // destination image
                        int s,  // source tile size
+                       int n,  // source height
+                       int m,  // source width
+                      bool e,  // destination is extended?
               const float *p)  // source buffer
 {
-    int i = 0;
-    for     (int r = y; r < y + s; r++)
-        for (int c = x; c < x + s; c++, i++)
-            rtoc(imgz(d, r, c), p + d->p * i, d->p);
+    for     (int r = y; r < min(y + s, n); r++)
+        for (int c = x; c < min(x + s, m); c++)
+        {
+            const float *q = p + d->p * ((r - y) * s + (c - x));
+
+            rtoc(d, imgzo(d, r, c), q);
+
+            if (e)
+                rtoc(d, imgzo(d, 2 * n - r - 1, m - c - 1), q);
+        }
 }
 
 // Copy one scanline of real TIFF data into a complex image cache.
 
 static void linetoimgr(int r,  // destination row
                       img *d,  // destination image
+                       int m,  // source width
               const float *p)  // source buffer
 {
-    for (int c = 0; c < 1 << d->m; c++)
-        rtoc(imgz(d, r, c), p + d->p * c, d->p);
+    for (int c = 0; c < m; c++)
+        rtoc(d, imgzo(d, r, c), p + d->p * c);
 }
 
 // Copy one scanline of real TIFF data from a complex image cache.
@@ -184,34 +199,46 @@ static void imgtoliner(int r,  // source row
                       img *d,  // source image
                     float *p)  // destination buffer
 {
-    for (int c = 0; c < 1 << d->m; c++)
-        ctor(p + d->p * c, imgz(d, r, c), d->p);
+    for (int c = 0; c < d->m; c++)
+        ctor(p + d->p * c, d, imgzo(d, r, c));
 }
 
 //------------------------------------------------------------------------------
 
-// Copy one tile of complex TIFF data into a complex image cache.
+// Copy one tile of complex TIFF data into a complex image cache, clipping it to
+// the bounds of the source image. If extending, copy each pixel to its image
+// in the rotated copy too.
 
 static void tiletoimgz(int y,  // destination row
                        int x,  // destination column
                       img *d,  // destination image
                        int s,  // source tile size
+                       int n,  // source height
+                       int m,  // source width
+                      bool e,  // destination is extended?
               const float *p)  // source buffer
 {
-    int i = 0;
-    for     (int r = y; r < y + s; r++)
-        for (int c = x; c < x + s; c++, i++)
-            ptoc(imgz(d, r, c), p + 2 * d->p * i, d->p);
+    for     (int r = y; r < min(y + s, n); r++)
+        for (int c = x; c < min(x + s, m); c++)
+        {
+            const float *q = p + 2 * d->p * ((r - y) * s + (c - x));
+
+            ptoc(d, imgzo(d, r, c), q);
+
+            if (e)
+                ptoc(d, imgzo(d, 2 * n - r - 1, m - c - 1), q);
+        }
 }
 
 // Copy one scanline of complex TIFF data into a complex image cache.
 
 static void linetoimgz(int r,  // destination row
                       img *d,  // destination image
+                       int m,  // source width
               const float *p)  // source buffer
 {
-    for (int c = 0; c < 1 << d->m; c++)
-        ptoc(imgz(d, r, c), p + 2 * d->p * c, d->p);
+    for (int c = 0; c < m; c++)
+        ptoc(d, imgzo(d, r, c), p + 2 * d->p * c);
 }
 
 // Copy one scanline of complex TIFF data from a complex image cache.
@@ -220,8 +247,8 @@ static void imgtolinez(int r,  // source row
                       img *d,  // source image
                     float *p)  // destination buffer
 {
-    for (int c = 0; c < 1 << d->m; c++)
-        ctop(p + 2 * d->p * c, imgz(d, r, c), d->p);
+    for (int c = 0; c < d->m; c++)
+        ctop(p + 2 * d->p * c, d, imgzo(d, r, c));
 }
 
 //------------------------------------------------------------------------------
@@ -239,12 +266,10 @@ static void reverse(float *p, int c, int n)
         }
 }
 
-// Copy a scanline-based TIFF to an image cache.
+// Copy a scanline-based TIFF of size n by m to an image cache.
 
-static bool scantoimg(img *d, TIFF *T, bool c, bool e)
+static bool scantoimg(img *d, TIFF *T, bool c, bool e, int n, int m)
 {
-    int n = 1 << (d->n - e);
-    int m = 1 <<  d->m;
     int r = 0;
     float *p;
 
@@ -253,17 +278,17 @@ static bool scantoimg(img *d, TIFF *T, bool c, bool e)
         for (r = 0; r < n; r++)
         {
             if (TIFFReadScanline(T, p, r, 0) == -1)
-                return false;
+                break;
 
-            if (c) linetoimgz(r, d, p);
-            else   linetoimgr(r, d, p);
+            if (c) linetoimgz(r, d, m, p);
+            else   linetoimgr(r, d, m, p);
 
             if (e)
             {
                 reverse(p, c ? d->p * 2 : d->p, m);
 
-                if (c) linetoimgz(2 * n - r - 1, d, p);
-                else   linetoimgr(2 * n - r - 1, d, p);
+                if (c) linetoimgz(2 * n - r - 1, d, m, p);
+                else   linetoimgr(2 * n - r - 1, d, m, p);
             }
         }
         free(p);
@@ -271,48 +296,45 @@ static bool scantoimg(img *d, TIFF *T, bool c, bool e)
     return (r == n);
 }
 
-// Copy a tile-based TIFF to an image cache.
+// Copy a tile-based TIFF of size n by m with tile size s to an image cache.
+// Tiles at the right and bottom may extend past the edge of the image.
 
-static bool tiletoimg(img *d, TIFF *T, bool c, int e, int k)
+static bool tiletoimg(img *d, TIFF *T, bool c, bool e, int n, int m, int s)
 {
-    int n = 1 << (d->n - e);
-    int m = 1 <<  d->m;
-    int s = 1 <<  k;
-    int y = 0;
-    int x = 0;
+    bool ok = false;
     float *p;
 
     if ((p = (float *) malloc(TIFFTileSize(T))))
     {
-        for     (y = 0; y < n; y += s)
-            for (x = 0; x < m; x += s)
+        ok = true;
+
+        for     (int y = 0; ok && y < n; y += s)
+            for (int x = 0; ok && x < m; x += s)
             {
                 if (TIFFReadTile(T, p, x, y, 0, 0) == -1)
-                    return false;
-
-                if (c) tiletoimgz(y, x, d, s, p);
-                else   tiletoimgr(y, x, d, s, p);
-
-                if (e)
-                {
-                    reverse(p, c ? d->p * 2 : d->p, s * s);
+                    ok = false;
 
-                    if (c) tiletoimgz(2 * n - y - s, m - x - s, d, s, p);
-                    else   tiletoimgr(2 * n - y - s, m - x - s, d, s, p);
-                }
+                else if (c) tiletoimgz(y, x, d, s, n, m, e, p);
+                else        tiletoimgr(y, x, d, s, n, m, e, p);
             }
         free(p);
     }
-    return (y == n && x == m);
+    return ok;
 }
 
 //------------------------------------------------------------------------------
 
-// Convert a TIFF to an image cache file.
+// Convert a TIFF to an image cache file. Round the size of the cache up to a
+// multiple of the tile size, padding with zero. An extended image must fill
+// its tiles exactly, as padding would break the period of the extension.
 
 static bool tiftoimg(bool v,    // verbose?
                       int e,    // destination is extended?
                       int l,    // log2 tile size
+                      int f,    // destination sample format
+                      int z,    // destination compression codec
+                      int y,    // destination tile layout
+              const char *s,    // destination stripe directories, or null
               const char *tif,  // source TIFF image file name
               const char *bin)  // destination image cache file name
 {
@@ -325,24 +347,35 @@ static bool tiftoimg(bool v,    // verbose?
     int  n = 0;
     int  m = 0;
     int  p = 0;
+    int  N = 0;
+    int  M = 0;
 
     if ((T = tifopenr(tif, &c, &k, &n, &m, &p)))
     {
-        if (imginit(bin, l, n + e, m, p, 0))
+        if (l < 0)
+            l = wistile(n << e, m, p);
+
+        N = ((n << e) + (1 << l) - 1) >> l << l;
+        M = ((m     ) + (1 << l) - 1) >> l << l;
+
+        if (e && (N != (n << e) || M != m))
+            apperr("Extended size of %s is not a multiple of the tile size",
+                                                                     tif);
+        else if (imginit(bin, l, N, M, p, f, z, y, s, 0))
         {
-            if ((d = imgopen(bin, l, n + e, m, p)))
+            if ((d = imgopen(bin, l, N, M, p)))
             {
                 if (k)
-                    ok = tiletoimg(d, T, c, e, k);
+                    ok = tiletoimg(d, T, c, e, n, m, k);
                 else
-                    ok = scantoimg(d, T, c, e);
+                    ok = scantoimg(d, T, c, e, n, m);
 
                 imgclose(d);
             }
         }
         TIFFClose(T);
     }
-    if (v) printf("%s %d %d %d %d\n", bin, l, n + e, m, p);
+    if (v) printf("%s %d %d %d %d\n", bin, l, imgarg(N), imgarg(M), p);
 
     return ok;
 }
@@ -352,8 +385,8 @@ static bool tiftoimg(bool v,    // verbose?
 static bool imgtotif(bool c,    // destination is complex?
                       int e,    // source is extended?
                       int l,    // source log2 tile size
-                      int n,    // source log2 height
-                      int m,    // source log2 width
+                      int n,    // source height
+                      int m,    // source width
                       int p,    // source pixel size
               const char *bin,  // source image cache file name
               const char *tif)  // destination TIFF image file name
@@ -368,11 +401,11 @@ static bool imgtotif(bool c,    // destination is complex?
     {
         if ((d = imgopen(bin, l, n, m, p)))
         {
-            if ((T = tifopenw(tif, c, n - e, m, p)))
+            if ((T = tifopenw(tif, c, n >> e, m, p)))
             {
                 if ((buf = malloc(TIFFScanlineSize(T))))
                 {
-                    for (r = 0; r < 1 << (n - e); r++)
+                    for (r = 0; r < n >> e; r++)
                     {
                         if (c)
                             imgtolinez(r, d, (float *) buf);
@@ -391,14 +424,17 @@ static bool imgtotif(bool c,    // destination is complex?
     }
     else apperr("Failed to guess image parameters", bin);
 
-    return (r == 1 << (n - e));
+    return (r == n >> e);
 }
 
 //------------------------------------------------------------------------------
 
 static int usage(const char *exe)
 {
-    fprintf(stderr, "Usage:\t%s [-tve] input.tif output.bin\n", exe);
+    fprintf(stderr, "Usage:\t%s [-tvezP] "
+                         "[-f format] "
+                         "[-s dirs] "
+                         "[-l size] input.tif output.bin\n", exe);
     fprintf(stderr, "\t%s [-tr] "
                          "[-l size] "
                          "[-n height] "
@@ -414,26 +450,37 @@ int main(int argc, char **argv)
     bool t  = false;
     bool c  = true;
     bool v  = false;
-    int  l  = 5;
+    int  l  = -1;
     int  n  = 0;
     int  m  = 0;
     int  p  = 0;
     int  e  = 0;
+    int  f  = IMG_C32;
+    int  z  = ZIP_NONE;
+    int  y  = IMG_INTERLEAVED;
     int  o;
 
+    const char *s = NULL;
+
     // Parse the command line options.
 
-    while ((o = getopt(argc, argv, "l:n:m:p:terv")) != -1)
+    while ((o = getopt(argc, argv, "f:s:l:n:m:p:tervzP")) != -1)
         switch (o)
         {
             case 't': t = true;                 break;
             case 'r': c = false;                break;
             case 'v': v = true;                 break;
+            case 'f': if ((f = imgfmt(optarg)) < 0)
+                          return usage(argv[0]);
+                      break;
+            case 's': s = optarg;               break;
             case 'l': l = strtol(optarg, 0, 0); break;
-            case 'n': n = strtol(optarg, 0, 0); break;
-            case 'm': m = strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = strtol(optarg, 0, 0); break;
             case 'e': e = 1;                    break;
+            case 'z': z = ZIP_ZLIB;             break;
+            case 'P': y = IMG_PLANAR;           break;
             case '?':
             default : return usage(argv[0]);
         }
@@ -450,7 +497,8 @@ int main(int argc, char **argv)
         if (optind + 2 == argc)
         {
             if (istif(argv[optind]))
-                ok = tiftoimg(v, e, l,          argv[optind], argv[optind + 1]);
+                ok = tiftoimg(v, e, l, f, z, y, s, argv[optind],
+                                                   argv[optind + 1]);
             else
                 ok = imgtotif(c, e, l, n, m, p, argv[optind], argv[optind + 1]);
         }
@@ -0,0 +1,785 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <complex.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+
+#include "dft.h"
+#include "img.h"
+#include "err.h"
+#include "etc.h"
+#include "fft.h"
+
+//------------------------------------------------------------------------------
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+static inline int omp_get_thread_num()  { return 0; }
+#endif
+
+// Overlap-save is selected by an option beyond those of the transform passes.
+
+enum
+{
+    OVERLAP = 1 << 16,
+};
+
+struct conv
+{
+    img           *d;       // image
+    img           *k;       // kernel spectrum image, if any
+    int            op;      // analytic kernel, if none
+    double         rr;      // analytic kernel squared radius
+    float          lo;      // threshold minimum
+    float          hi;      // threshold maximum
+    bool           sel;     // threshold enabled
+    float complex *gy;      // Gaussian column spectrum
+    float complex *gx;      // Gaussian row spectrum
+    float complex *w;       // column FFT tables
+    float complex *c;       // per-thread column kernel spectrum
+    float complex *t;       // per-thread FFT scratch
+    int           *x;       // per-thread column of c
+    int            T;       // FFT scratch length
+};
+
+//------------------------------------------------------------------------------
+
+// Allocate the FFT tables for lines of length n, and give the scratch length.
+
+static float complex *tables(int n, int *T)
+{
+    *T = ispow2(n) ? n : mixsize(n);
+    return ispow2(n) ? twialloc(n) : mixalloc(n);
+}
+
+// Compute the spectrum of a Gaussian line of length n with squared radius rr,
+// centered at the origin as by the kernel utility, and normalize it to unit
+// gain. The Gaussian is separable, so the outer product of the column and row
+// spectra is the spectrum of the 2D kernel.
+
+static float complex *gauss(int n, double rr)
+{
+    float complex *g = NULL;
+    float complex *w = NULL;
+    float complex *t = NULL;
+    int            T;
+
+    if ((g = (float complex *) malloc(n * sizeof (float complex))) &&
+        (w = tables(n, &T)) &&
+        (t = (float complex *) malloc(T * sizeof (float complex))))
+    {
+        for (int i = 0; i < n; i++)
+        {
+            const int y = (i < (n + 1) / 2) ? i : i - n;
+
+            g[i] = (float) exp(-0.5 * y * y / rr);
+        }
+
+        anyfft(+1, n, w, g, t);
+
+        const float k = 1.f / crealf(g[0]);
+
+        for (int i = 0; i < n; i++)
+            g[i] *= k;
+    }
+    else
+    {
+        free(g);
+        g = NULL;
+    }
+    free(t);
+    free(w);
+    return g;
+}
+
+// Compute column X of the spectrum of the circle kernel in c. Transform each
+// row of the circle analytically, as the transform of a run of 2w + 1 ones is
+// the Dirichlet kernel, and then transform the resulting column. Normalize the
+// kernel to unit gain.
+
+static void circle(struct conv *v, int X, float complex *c, float complex *t)
+{
+    const int n = v->d->n;
+    const int m = v->d->m;
+    const int u = dftfreq(X, m);
+    const int R = (int) ceil(sqrt(v->rr));
+
+    double S = 0.0;
+
+    for (int i = 0; i < n; i++)
+        c[i] = 0.f;
+
+    for (int y = -R; y <= R; y++)
+        if (y * y < v->rr)
+        {
+            int w = (int) floor(sqrt(v->rr - y * y));
+
+            if (w * w >= v->rr - y * y)
+                w--;
+
+            const double k = 2 * w + 1;
+            const double a = M_PI * u / m;
+
+            c[(y + n) % n] = (float) (u ? sin(a * k) / sin(a) : k);
+            S += k;
+        }
+
+    anyfft(+1, n, v->w, c, t);
+
+    for (int i = 0; i < n; i++)
+        c[i] /= (float) S;
+}
+
+//------------------------------------------------------------------------------
+
+// Multiply column y of the spectrum of channel k of the image by the kernel.
+
+static void multiply(struct conv *v, int y, int k,
+                     float complex *z, int s, int n)
+{
+    if (v->k)
+    {
+        const int K = min(k, v->k->p - 1);
+
+        for (int i = 0; i < n; i++)
+        {
+            const size_t o = imgzo(v->k, dftpos(i, n), y);
+
+            z[i * s] *= imgval(v->k, imgco(v->k, o, K));
+        }
+    }
+    else if (v->op == 'g')
+    {
+        const float complex g = v->gx[dftfreq(y, v->d->m)];
+
+        for (int i = 0; i < n; i++)
+            z[i * s] *= v->gy[i] * g;
+    }
+    else
+    {
+        const int      j = omp_get_thread_num();
+        float complex *c = v->c + (size_t) n * j;
+        float complex *t = v->t + (size_t) v->T * j;
+
+        if (v->x[j] != y)
+        {
+            circle(v, y, c, t);
+            v->x[j] = y;
+        }
+
+        for (int i = 0; i < n; i++)
+            z[i * s] *= c[i];
+    }
+}
+
+// Select the samples of a line in the threshold range.
+
+static void threshold(struct conv *v, float complex *z, int s, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const float a = cabsf(z[i * s]);
+
+        z[i * s] = (v->lo <= a && a <= v->hi) ? 1.f : 0.f;
+    }
+}
+
+// Hook the lines of each pass. The column-wise pass returns to the spatial
+// domain, so each column is multiplied by the kernel in between. The final
+// row-wise pass is inverse, and its output may be thresholded.
+
+static void apply(void *data, int opt, int y, int k,
+                  float complex *z, int s, int n)
+{
+    struct conv *v = (struct conv *) data;
+
+    if      (opt & RETURN)
+        multiply (v, y, k, z, s, n);
+    else if ((opt & INVERSE) && v->sel)
+        threshold(v, z, s, n);
+}
+
+//------------------------------------------------------------------------------
+
+// Convolve the image with the kernel in three passes: a forward row-wise FFT, a
+// column-wise pass that transforms, multiplies, and transforms back, and an
+// inverse row-wise FFT.
+
+static bool convolve(struct conv *v, int opt, size_t B)
+{
+    const int n = v->d->n;
+    const int N = omp_get_max_threads();
+
+    dfthook f = { apply, v };
+    bool   ok = false;
+
+    int o[3] = {
+        opt,
+        (opt & (AUTOSORT | BATCH)) | TRANSPOSE | RETURN,
+        opt | INVERSE,
+    };
+
+    if (v->op == 'g')
+        ok = (v->gy = gauss(v->d->n, v->rr)) &&
+             (v->gx = gauss(v->d->m, v->rr));
+
+    else if (v->op == 'c')
+        ok = (v->w = tables(n, &v->T)) &&
+             (v->c = (float complex *) malloc(N * n    * sizeof (*v->c))) &&
+             (v->t = (float complex *) malloc(N * v->T * sizeof (*v->t))) &&
+             (v->x = (int           *) malloc(N        * sizeof (*v->x)));
+    else
+        ok = true;
+
+    if (ok)
+    {
+        if (v->x)
+            for (int j = 0; j < N; j++)
+                v->x[j] = -1;
+
+        ok = dftpass(v->d, 3, o, B, &f);
+    }
+    else apperr("Failed to allocate kernel spectrum");
+
+    free(v->gy);
+    free(v->gx);
+    free(v->w);
+    free(v->c);
+    free(v->t);
+    free(v->x);
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+// Overlap-save convolution works block by block, transforming each block of the
+// image together with a halo the width of the kernel support in a small FFT,
+// and keeping only the part of the result unaffected by the circular wrap. The
+// cost thus scales with the kernel size rather than the image size, and the
+// image is swept once. Blocks are gathered in units of whole tiles from a strip
+// of the original rows of tiles, so that the image may be written in place as
+// each row of units is finished.
+
+// Give the half-width of the support of the analytic kernel. A Gaussian is
+// truncated at five radii, beyond which its weights are below 4e-6.
+
+static int support(const struct conv *v)
+{
+    if (v->op == 'g')
+        return (int) ceil(5.0 * sqrt(v->rr));
+    else
+    {
+        int h = (int) floor(sqrt(v->rr));
+
+        return (h * h < v->rr) ? h : h - 1;
+    }
+}
+
+// Give the weight of the analytic kernel at offset (y, x).
+
+static double weight(const struct conv *v, int y, int x)
+{
+    const double dd = (double) y * y + (double) x * x;
+
+    if (v->op == 'g')
+        return exp(-0.5 * dd / v->rr);
+    else
+        return (dd < v->rr) ? 1.0 : 0.0;
+}
+
+// Choose the FFT size F for half-width h, minimizing the work per output pixel,
+// with blocks no larger than needed to cover an image of size n.
+
+static int blocksize(int h, int n)
+{
+    double b = 0.0;
+    int    F = 2;
+    int    G;
+
+    while (F < 2 * h + 2)
+        F *= 2;
+
+    for (G = F; G <= max(F, 512); G *= 2)
+    {
+        const double B = G - 2 * h;
+        const double c = (double) G * G * log2i(G) / (B * B);
+
+        if (b == 0.0 || c < b)
+        {
+            b = c;
+            F = G;
+        }
+        if (B >= n)
+            break;
+    }
+    return F;
+}
+
+// Choose the side u of a unit, in tiles of size s, to be covered by blocks of
+// at most B pixels, minimizing the blocks per pixel. Units are at most two
+// blocks across, unless a single tile is larger, and no larger than needed to
+// cover an image of size n.
+
+static int unitsize(int B, int s, int n)
+{
+    int u = 1;
+
+    for (int v = 2; v * s <= max(s, 2 * B) && v * s <= n; v++)
+        if ((v * s + B - 1) / B * u < (u * s + B - 1) / B * v)
+            u = v;
+
+    return u;
+}
+
+// Transform an F by F block in place, row-wise then column-wise. The columns
+// are interleaved lines and go by batchfft all at once.
+
+static void block2(int s, int F, const float complex *w, float complex *a,
+                                                           float complex *t)
+{
+    for (int i = 0; i < F; i++)
+        stockham(s, F, w, a + (size_t) F * i, t);
+
+    batchfft(s, F, F, w, a, t);
+}
+
+// Compute the F by F spectrum of the analytic kernel of half-width h, centered
+// at the origin and normalized to unit gain.
+
+static void spectrum(const struct conv *v, int F, int h, const float complex *w,
+                                     float complex *K, float complex *t)
+{
+    double S = 0.0;
+
+    for (int i = 0; i < F * F; i++)
+        K[i] = 0.f;
+
+    for     (int y = -h; y <= h; y++)
+        for (int x = -h; x <= h; x++)
+            S += weight(v, y, x);
+
+    for     (int y = -h; y <= h; y++)
+        for (int x = -h; x <= h; x++)
+            K[(size_t) F * ((y + F) % F) + (x + F) % F] = weight(v, y, x) / S;
+
+    block2(+1, F, w, K, t);
+}
+
+// Copy tile rows [r0, r1) of the original image to tile rows [i, ...) of the
+// strip, widened, by way of raw buffer z. Rows wrapping past the bottom of the
+// image come from the saved head of the image, as the top of the image has
+// been overwritten by the time they are needed.
+
+static bool load(img *d, float complex *strip, const float complex *head,
+                                       void *z, int i, int r0, int r1)
+{
+    const size_t L = (size_t) d->t * d->w;
+
+    img f = *d;
+
+    f.a = z;
+    f.h = 1;
+
+    for (int r = r0; r < r1; r++)
+    {
+        float complex *y = strip + L * (i + r - r0);
+        const int      R = (r % d->h + d->h) % d->h;
+        int            c;
+
+        if (r >= d->h)
+            memcpy(y, head + L * R, L * sizeof (float complex));
+
+        else if (d->k == IMG_C32)
+        {
+            if (!imgload(d, R, 0, 1, d->w, y))
+                return false;
+        }
+        else
+        {
+            if (!imgload(d, R, 0, 1, d->w, z))
+                return false;
+
+            #pragma omp parallel for
+            for (c = 0; c < d->w; c++)
+                imgwiden(&f, 0, c, y + (size_t) d->t * c);
+        }
+    }
+    return true;
+}
+
+// Give the buffer of tile (i, j) of the unit of m tiles per row at tile (r, c),
+// the image itself where it may be written in place, else a part of buffer O.
+
+static float complex *target(img *d, float complex *O,
+                             int r, int c, int m, int i, int j)
+{
+    if (d->k == IMG_C32)
+        return imgbuf(d, r + i, c + j, 0, 0);
+    else
+        return O + (size_t) d->t * (m * i + j);
+}
+
+// Convolve the unit of n by m tiles at tile (r, c), split evenly into blocks of
+// at most b rows and columns, each read with halo h from the strip e of tiles
+// beginning at tile row q. Each run of a row within a tile is gathered from the
+// strip and scattered to its tile whole. Once all blocks and channels are done,
+// each tile is narrowed into the image.
+
+static void unit(struct conv *v, const img *e, int q, int F, int h, int b,
+                 const float complex *w, const float complex *K,
+                 int r, int c, int n, int m,
+                 float complex *a, float complex *t, float complex *O)
+{
+    img *d = v->d;
+
+    const int s  = d->s;
+    const int Y0 = r << d->l, H = n << d->l, P = (H + b - 1) / b;
+    const int X0 = c << d->l, W = m << d->l, Q = (W + b - 1) / b;
+
+    for         (int y = 0; y < P; y++)
+        for     (int x = 0; x < Q; x++)
+            for (int k = 0; k < d->p; k++)
+            {
+                const int Y = Y0 + H *  y      / P;
+                const int X = X0 + W *  x      / Q;
+                const int B = Y0 + H * (y + 1) / P - Y;
+                const int C = X0 + W * (x + 1) / Q - X;
+
+                // Gather the block and its halo, wrapping around the image.
+
+                for (int i = 0; i < F; i++)
+                {
+                    float complex *y = a + (size_t) F * i;
+                    int            j = 0;
+
+                    if (i < B + 2 * h)
+                    {
+                        const int yy = Y - h + i - (q << d->l);
+
+                        while (j < C + 2 * h)
+                        {
+                            const int xx = (X - h + j + d->m) % d->m;
+                            const int l  = min(C + 2 * h - j,
+                                               s - (xx & (s - 1)));
+
+                            const float complex *z = (const float complex *)
+                                e->a + imgco(e, imgzo(e, yy, xx), k);
+
+                            for (int x = 0; x < l; x++, j++)
+                                y[j] = z[(size_t) x * d->g];
+                        }
+                    }
+                    for (; j < F; j++)
+                        y[j] = 0.f;
+                }
+
+                block2(+1, F, w, a, t);
+
+                for (int i = 0; i < F * F; i++)
+                    a[i] *= K[i];
+
+                block2(-1, F, w, a, t);
+
+                // Scatter the part of the result unaffected by the wrap.
+
+                for (int i = 0; i < B; i++)
+                {
+                    const int yy = Y + i;
+
+                    for (int j = 0; j < C; )
+                    {
+                        const int xx = X + j;
+                        const int l  = min(C - j, s - (xx & (s - 1)));
+
+                        float complex *z = a + (size_t) F * (i + h) + j + h;
+                        float complex *D = target(d, O, r, c, m,
+                                                  (yy - Y0) >> d->l,
+                                                  (xx - X0) >> d->l);
+
+                        D += imgco(d, imgbo(d, 0, 0, yy & (s - 1),
+                                                     xx & (s - 1)), k);
+
+                        if (v->sel)
+                            threshold(v, z, 1, l);
+
+                        for (int x = 0; x < l; x++, j++)
+                            D[(size_t) x * d->g] = z[x];
+                    }
+                }
+            }
+
+    for     (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            imgnarrow(d, r + i, c + j, target(d, O, r, c, m, i, j));
+}
+
+// Convolve the image by overlap-save, one row of units at a time. A unit is a
+// square of whole tiles, covered by as few blocks as will do. Each row of units
+// is read from the strip of original tile rows covering its halo, o above and o
+// below, widened as they are read, and the units of the row are processed in
+// parallel. Before the next row, the last 2o tile rows of the strip are moved
+// to its top and the rest are read anew.
+
+static bool overlap(struct conv *v)
+{
+    img *d = v->d;
+
+    const int    h = support(v);
+    const int    F = blocksize(h, max(d->n, d->m));
+    const int    b = F - 2 * h;
+    const int    u = unitsize(b, d->s, min(d->n, d->m));
+    const int    o = (h + d->s - 1) >> d->l;
+    const int    N = omp_get_max_threads();
+    const size_t L = (size_t) d->t * d->w;
+    const size_t S = (size_t) F * F;
+    const size_t U = (size_t) d->t * u * u;
+
+    float complex *w     = NULL;
+    float complex *K     = NULL;
+    float complex *a     = NULL;
+    float complex *strip = NULL;
+    float complex *head  = NULL;
+    void          *z     = NULL;
+
+    bool ok = false;
+
+    if (2 * h >= min(d->n, d->m))
+        apperr("Kernel support must be less than half the image size");
+
+    else if ((w     = twialloc(F)) &&
+             (K     = (float complex *) malloc(S * sizeof (*K))) &&
+             (a     = (float complex *) malloc((S * 2 + U) * N * sizeof (*a))) &&
+             (strip = (float complex *) imgalloc(L * (u + o + o) * sizeof (*strip))) &&
+             (head  = (float complex *) malloc(L * max(o, 1) * sizeof (*head))) &&
+             (z     = malloc(L * imgsize(d->k))))
+    {
+        img e = *d;
+        int r;
+        int j;
+
+        e.a = strip;
+        e.k = IMG_C32;
+        e.h = u + o + o;
+
+        spectrum(v, F, h, w, K, a);
+        imghint(d, IMG_SEQUENTIAL);
+
+        ok = load(d, head,  NULL, z, 0, 0,  o)
+          && load(d, strip, head, z, 0, -o, min(u, d->h) + o);
+
+        for (r = 0; ok && r < d->h; r += u)
+        {
+            const int n = min(u, d->h - r);
+
+            #pragma omp parallel for schedule(dynamic)
+            for (j = 0; j < (d->w + u - 1) / u; j++)
+            {
+                float complex *A = a + (S * 2 + U) * omp_get_thread_num();
+                const int      c = j * u;
+
+                unit(v, &e, r - o, F, h, b, w, K, r, c, n, min(u, d->w - c),
+                                                  A, A + S, A + S * 2);
+            }
+
+            if (r + n < d->h)
+            {
+                const int m = min(u, d->h - r - n);
+
+                memmove(strip, strip + L * n, L * 2 * o * sizeof (*strip));
+                ok = load(d, strip, head, z, 2 * o, r + n + o, r + n + m + o);
+            }
+        }
+    }
+    else apperr("Failed to allocate overlap-save buffers");
+
+    free(z);
+    free(head);
+    imgfree(strip, L * (u + o + o) * sizeof (*strip));
+    free(a);
+    free(K);
+    free(w);
+
+    return ok;
+}
+
+// Confirm that the input conforms to spec, open the image and kernel, and then
+// do the job.
+
+static bool proc(const char *name, // image file name
+                 const char *kern, // kernel file name
+                         int l,    // log2 tile size
+                         int n,    // image height
+                         int m,    // image width
+                         int p,    // pixel size
+                       float r,    // kernel radius
+                       float lo,   // threshold minimum
+                       float hi,   // threshold maximum
+                         int op,   // analytic kernel
+                         int opt,  // option flags
+                      size_t B)    // memory budget
+{
+    struct conv v = { 0 };
+
+    bool ok = false;
+
+    if ((kern != NULL) == (op != 0))
+        apperr("Give either a kernel image or a kernel radius");
+
+    else if (op && r <= 0)
+        apperr("Kernel radius must be positive");
+
+    else if ((opt & OVERLAP) && kern)
+        apperr("Overlap-save requires an analytic kernel");
+
+    else if ((n && m && p) || imgargs(name, &n, &m, &p))
+    {
+        if (op == 'c' && 2 * r >= min(n, m))
+        {
+            apperr("Kernel radius must be less than half the image size");
+            return false;
+        }
+
+        opt |= dftwisdom(l, n, m, p);
+
+        v.op = op;
+        v.rr = (double) r * r;
+        v.lo = lo;
+        v.hi = hi;
+        v.sel = (lo > -FLT_MAX || hi < FLT_MAX);
+
+        // A real image is widened to hold its spectrum for the duration of a
+        // whole-image convolution. Overlap-save writes its real result as is.
+
+        const bool R = !(opt & OVERLAP) && imgformat(name) == IMG_R32;
+
+        if ((!R || imgconvert(name, l, n, m, p, IMG_C32))
+                && (v.d = imgopen(name, l, n, m, p)))
+        {
+            if (kern == NULL || (v.k = imgopen(kern, v.d->l, n, m, p)))
+            {
+                if (v.k) imgkeep(v.k);
+
+                if (v.k && v.k->e != (IMG_ROWS | IMG_COLS))
+                    apperr("Kernel %s does not hold a spectrum", kern);
+
+                else if (opt & OVERLAP)
+                    ok = overlap(&v);
+                else
+                    ok = convolve(&v, opt, B);
+
+                if (v.k) imgclose(v.k);
+            }
+            imgclose(v.d);
+
+            if (ok && R)
+                ok = imgconvert(name, l, n, m, p, IMG_R32);
+        }
+    }
+    else apperr("Failed to guess '%s' image parameters", name);
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+static int usage(const char *exe)
+{
+    fprintf(stderr, "Usage:\t%s [-tRVOgc] "
+                               "[-r radius] "
+                               "[-s min] "
+                               "[-S max] "
+                               "[-B budget] "
+                               "[-l size] "
+                               "[-n height] "
+                               "[-m width] "
+                               "[-p samples] image [kernel]\n", exe);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv)
+{
+    bool  ok  = false;
+    bool  t   = false;
+    int   opt = 0;
+    int   op  = 0;
+    int   l   = -1;
+    int   n   = 0;
+    int   m   = 0;
+    int   p   = 0;
+    float r   = 0;
+    float lo  = -FLT_MAX;
+    float hi  =  FLT_MAX;
+    int   o;
+
+    size_t B  = 0;
+
+    // Parse the command line options.
+
+    while ((o = getopt(argc, argv, "RVOgcr:s:S:B:l:n:m:p:t")) != -1)
+        switch (o)
+        {
+            case 'l': l = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
+            case 'p': p = (int) strtol(optarg, 0, 0); break;
+            case 'r': r  =      strtof(optarg, 0);    break;
+            case 's': lo =      strtof(optarg, 0);    break;
+            case 'S': hi =      strtof(optarg, 0);    break;
+
+            case 'B':
+                if ((B = strtosize(optarg)) == 0)
+                    return usage(argv[0]);
+                break;
+
+            case 'R': opt |= REAL;    break;
+            case 'V': opt |= BATCH;   break;
+            case 'O': opt |= OVERLAP; break;
+
+            case 'g': op = o; break;
+            case 'c': op = o; break;
+
+            case 't': t = true; break;
+            case '?':
+            default : return usage(argv[0]);
+        }
+
+    // Confirm the arguments and run the process.
+
+    setexe(argv[0]);
+
+    struct timeval t0;
+    struct timeval t1;
+
+    gettimeofday(&t0, 0);
+    {
+        if (optind + 1 == argc)
+            ok = proc(argv[optind], NULL,             l, n, m, p,
+                      r, lo, hi, op, opt, B);
+        else if (optind + 2 == argc)
+            ok = proc(argv[optind], argv[optind + 1], l, n, m, p,
+                      r, lo, hi, op, opt, B);
+        else
+            return usage(argv[0]);
+    }
+    gettimeofday(&t1, 0);
+
+    if (t) printtime(&t0, &t1);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,704 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dft.h"
+#include "img.h"
+#include "err.h"
+#include "etc.h"
+#include "fft.h"
+#include "wis.h"
+
+//------------------------------------------------------------------------------
+
+// Rotate index x of a line of length n by h, where a forward transform rotates
+// its output by half the length and an inverse rotates its input back again.
+// This places the DC term at the center, index n / 2.
+
+static inline int offset(int x, int n, int h)
+{
+    return (x + h < n) ? x + h : x + h - n;
+}
+
+static inline int getshift(int n, int s)
+{
+    return (s > 0) ? 0 : n - n / 2;
+}
+
+static inline int putshift(int n, int s)
+{
+    return (s > 0) ? n - n / 2 : 0;
+}
+
+// Locate sample x of line i of a raster of n lines of length m and p channels.
+// Lines are planar by default, each channel of each line a contiguous run, and
+// channels n * m apart. Given a batch width b, the raster is instead grouped
+// by batches of b / p lines, interleaved with their channels adjacent, so that
+// batchfft may transform each group at once. The channel stride is then one.
+
+static inline float complex *raster(float complex *z, int n, int m, int p,
+                                                      int b, int i, int x)
+{
+    if (b)
+        return z + ((size_t) (i / (b / p)) * m + x) * b + (i % (b / p)) * p;
+    else
+        return z + (size_t) i * m + x;
+}
+
+static inline int stride(int n, int m, int b)
+{
+    return b ? 1 : n * m;
+}
+
+// Determine whether each row of each channel of a tile is a contiguous run in
+// both image d and an in-order planar raster, where the row begins at offset x
+// of a line of length m, so that rows may be copied whole. This is so of the
+// complex float images with planar tiles, or with only one channel.
+
+static inline bool runs(const img *d, int b, const int *v, int x, int m)
+{
+    return d->k == IMG_C32 && d->g == 1 && b == 0 && v == NULL
+                                        && x + d->s <= m;
+}
+
+// Copy one row of tiles from the image to a raster. De-interleave the channels
+// and apply the offset and index bit reversal in preparation for FFT. Use a
+// tile-wise ordering for best input cache coherence. If the bit reversal table
+// v is null then the FFT sorts for itself and the raster is written in order.
+
+static void getrow(img *d, int r, int s, int b, const int *v, float complex *z)
+{
+    const int h = getshift(d->m, s);
+    const int k = stride(d->s, d->m, b);
+
+    for (int c = 0; c < d->w; c++)
+    {
+        const int x = offset(c << d->l, d->m, h);
+
+        if (runs(d, b, v, x, d->m))
+            for (int i = 0; i < d->s; i++)
+            {
+                float complex *y = raster(z, d->s, d->m, d->p, b, i, x);
+
+                for (int q = 0; q < d->p; q++)
+                    memcpy(y + (size_t) k * q, imgrow(d, r, c, i, q),
+                                               sizeof (float complex) * d->s);
+            }
+        else
+            for     (int i = 0; i < d->s; i++)
+                for (int j = 0; j < d->s; j++)
+                {
+                    const int o = offset((c << d->l) + j, d->m, h);
+                    const int y = v ? v[o] : o;
+
+                    imgget(d, r, c, i, j,
+                           raster(z, d->s, d->m, d->p, b, i, y), k);
+                }
+    }
+}
+
+// Copy one row of tiles from a raster to the image. Re-interleave the channels
+// and apply the offset following the FFT. Use a tile-wise ordering for best
+// output cache coherence.
+
+static void putrow(img *d, int r, int s, int b, float complex *z)
+{
+    const int h = putshift(d->m, s);
+    const int k = stride(d->s, d->m, b);
+
+    for (int c = 0; c < d->w; c++)
+    {
+        const int x = offset(c << d->l, d->m, h);
+
+        if (runs(d, b, NULL, x, d->m))
+            for (int i = 0; i < d->s; i++)
+            {
+                float complex *y = raster(z, d->s, d->m, d->p, b, i, x);
+
+                for (int q = 0; q < d->p; q++)
+                    memcpy(imgrow(d, r, c, i, q), y + (size_t) k * q,
+                                               sizeof (float complex) * d->s);
+            }
+        else
+            for     (int i = 0; i < d->s; i++)
+                for (int j = 0; j < d->s; j++)
+                {
+                    const int y = offset((c << d->l) + j, d->m, h);
+
+                    imgput(d, r, c, i, j,
+                           raster(z, d->s, d->m, d->p, b, i, y), k);
+                }
+    }
+}
+
+// Transpose one column of tiles from the image to a raster. De-interleave the
+// channels and apply the offset and index bit reversal in preparation for FFT.
+// Use a tile-wise ordering for best input cache coherence. A null v gives an
+// in-order raster, as with getrow. Work upward from the bottom tile row, as the
+// last rows touched by a preceding row-wise pass are the likeliest to remain
+// in the page cache of an image larger than RAM.
+
+static void getcol(img *d, int c, int s, int b, const int *v, float complex *z)
+{
+    const int h = getshift(d->n, s);
+    const int k = stride(d->s, d->n, b);
+
+    for         (int r = d->h - 1; r >= 0; r--)
+        for     (int i = 0; i < d->s; i++)
+            for (int j = 0; j < d->s; j++)
+            {
+                const int o = offset((r << d->l) + i, d->n, h);
+                const int y = v ? v[o] : o;
+
+                imgget(d, r, c, i, j, raster(z, d->s, d->n, d->p, b, j, y), k);
+            }
+}
+
+// Transpose one column of tiles from a raster to the image. Re-interleave the
+// channels and apply the offset following the FFT. Use a tile-wise ordering for
+// best output cache coherence, in the same order as getcol.
+
+static void putcol(img *d, int c, int s, int b, float complex *z)
+{
+    const int h = putshift(d->n, s);
+    const int k = stride(d->s, d->n, b);
+
+    for         (int r = d->h - 1; r >= 0; r--)
+        for     (int i = 0; i < d->s; i++)
+            for (int j = 0; j < d->s; j++)
+            {
+                const int y = offset((r << d->l) + i, d->n, h);
+
+                imgput(d, r, c, i, j, raster(z, d->s, d->n, d->p, b, j, y), k);
+            }
+}
+
+//------------------------------------------------------------------------------
+
+// Transform a raster. If scratch space t is given then the raster is in order
+// and the Stockham autosort FFT applies, or the mixed-radix FFT if the length
+// is not a power of two. Otherwise the raster is bit-reversed. Given a batch
+// width b, transform each batch of b interleaved lines at once.
+
+static void transform(int n,  // raster rows
+                      int m,  // raster columns
+                      int p,  // pixel size
+                      int b,  // batch width
+                      int s,  // transformation sign
+     const float complex *w,  // twiddle factors
+           float complex *t,  // scratch buffer
+           float complex *z)  // raster buffer
+{
+    int r;
+    int k;
+
+    if (b)
+        for (r = 0; r < n * p; r += b)
+            batchfft(s, m, b, w, z + (size_t) m * r, t);
+    else
+        for     (k = 0; k < p; k++)
+            for (r = 0; r < n; r++)
+                anyfft(s, m, w, z + n * m * k + m * r, t);
+}
+
+// Transform a raster of real rows, or of the Hermitian spectra of real rows,
+// two rows per FFT. All channels of all rows are paired alike. An odd row out
+// is transformed alone, and its imaginary part dropped.
+
+static void transformr(int n,  // raster rows
+                       int m,  // raster columns
+                       int p,  // pixel size
+                       int s,  // transformation sign
+      const float complex *w,  // twiddle factors
+            float complex *t,  // scratch buffer
+            float complex *z)  // raster buffer
+{
+    int r;
+
+    for (r = 0; r + 1 < n * p; r += 2)
+        realfft(s, m, w, t, z + m * r, z + m * r + m);
+
+    if (r < n * p)
+    {
+        float complex *y = z + m * r;
+
+        if (s > 0)
+            for (int k = 0; k < m; k++)
+                y[k] = crealf(y[k]);
+
+        anyfft(s, m, w, y, t);
+
+        if (s < 0)
+            for (int k = 0; k < m; k++)
+                y[k] = crealf(y[k]);
+    }
+}
+
+// Return the batch width for lines of length m of an image with tile size n
+// and pixel size p, or zero if they are to be transformed one by one. A batch
+// is all channels of eight lines, or of all n lines if fewer, and so fills an
+// AVX-512 vector for any p. Real rows and lengths that are not powers of two
+// are never batched.
+
+static int batch(int n, int m, int p, int opt)
+{
+    if ((opt & BATCH) && ispow2(m) && !((opt & REAL) && !(opt & TRANSPOSE)))
+        return p * min(8, n);
+    else
+        return 0;
+}
+
+// Present each line of a transformed raster to hook f. Line r of the raster is
+// line y0 + r of the image.
+
+static void hook(const dfthook *f, int opt, int y0,
+                 int n, int m, int p, int b, float complex *z)
+{
+    for     (int r = 0; r < n; r++)
+        for (int k = 0; k < p; k++)
+        {
+            float complex *y = b ? raster(z, n, m, p, b, r, 0) + k
+                                 : z + (size_t) n * m * k + m * r;
+
+            f->f(f->data, opt, y0 + r, k, y, b ? b : 1, m);
+        }
+}
+
+// The final pass tallies the statistics of each tile it writes.
+
+enum { TALLY = 1 << 8 };
+
+// Tally each tile of line i of a pass, as written. Tile (r, c) of d is tile
+// (r, c + o) or (r + o, c) of the whole image, as d may be a slab. Buffer z
+// must hold one tile.
+
+static void tally(img *d, int opt, int i, int o, float complex *z)
+{
+    if (opt & TRANSPOSE)
+        for (int r = 0; r < d->h; r++)
+            imgtally(d, r, i + o, imgwiden(d, r, i, z));
+    else
+        for (int c = 0; c < d->w; c++)
+            imgtally(d, i + o, c, imgwiden(d, i, c, z));
+}
+
+// Orchestrate the Fourier transform of the ith row of tiles of image d. Gather
+// a set of tiles from the image, transform each line, and copy the results
+// back. This function forms the kernel of the OpenMP parallelization. Given a
+// hook, apply it to each line before it is written back, and if the pass is a
+// RETURN then transform the line back again first. Row i of tiles of d is row
+// i + c of the whole image, as d may be a slab. The raster is free to serve as
+// a tile buffer for the tally once written.
+
+static void dorow(img *d,
+                   int i,
+                   int c,
+                   int opt,
+        const dfthook *f,
+            const int *v,
+  const float complex *w,
+        float complex *z)
+{
+    const int n = d->s;
+    const int m = d->s * ((opt & TRANSPOSE) ? d->h : d->w);
+    const int p = d->p;
+
+    const int s = (opt & INVERSE) ? -1 : +1;
+    const int b = batch(n, m, p, opt);
+    const int e = (opt & RETURN)  ? -s : s;
+
+    float complex *t = ((opt & AUTOSORT) || !ispow2(m)) ? z + n * m * p : NULL;
+
+    if (t) v = NULL;
+
+    if (opt & TRANSPOSE) getcol(d, i, s, b, v, z);
+    else                 getrow(d, i, s, b, v, z);
+
+    if ((opt & REAL) && !(opt & TRANSPOSE))
+        transformr(n, m, p,    s, w, t, z);
+    else
+        transform (n, m, p, b, s, w, t, z);
+
+    if (f)
+        hook(f, opt, (i + c) * n, n, m, p, b, z);
+
+    if (opt & RETURN)
+        transform (n, m, p, b, e, w, t, z);
+
+    if (opt & TRANSPOSE) putcol(d, i, e, b, z);
+    else                 putrow(d, i, e, b, z);
+
+    if ((opt & TALLY) && d->x)
+        tally(d, opt, i, c, z);
+}
+
+// Ask for line i of a pass to begin loading. A thread of a static schedule
+// takes its lines in order, so it may fetch its next line as it begins each,
+// and that line loads while this one is transformed. A column is one tile from
+// each row of tiles, which readahead cannot predict.
+
+static void fetch(img *d, int opt, int i)
+{
+    if (opt & TRANSPOSE)
+        imgfetch(d, 0, i, d->h, 1);
+    else
+        imgfetch(d, i, 0, 1, d->w);
+}
+
+//------------------------------------------------------------------------------
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+static inline int omp_get_thread_num()  { return 0; }
+static inline void omp_set_num_threads(int n) { }
+#endif
+
+// Give the block of tiles of slab k of b rows (or columns) of tiles, of H.
+
+static void place(img *d, int opt, int b, int H, int k,
+                  int *r, int *c, int *h, int *w)
+{
+    const int n = min(b, H - k);
+
+    *r = (opt & TRANSPOSE) ? 0    : k;
+    *c = (opt & TRANSPOSE) ? k    : 0;
+    *h = (opt & TRANSPOSE) ? d->h : n;
+    *w = (opt & TRANSPOSE) ? n    : d->w;
+}
+
+// Wait for the transfers of the Y slab buffers, noting any failure.
+
+static bool await(int Y, bool ok)
+{
+    for (int j = 0; j < Y; j++)
+        ok = imgwait(j + 1) && ok;
+    return ok;
+}
+
+// Transform one pass of the image out-of-core, reading each slab of b rows (or
+// columns) of tiles into a buffer with sequential reads, transforming it there,
+// and writing it back. The slab is presented to dorow as an image of its own,
+// so page faults on the image mapping never occur.
+//
+// Given one buffer, the next slab is fetched while this one is transformed.
+// Given Y buffers, the slabs go round them, each buffer with an I/O group of
+// its own, and the next slab is read and the previous ones written while this
+// one is transformed. A buffer is reused only once its write is complete.
+
+static bool slab(img *d, int opt, int b, const dfthook *f,
+                                          const int *v,
+                                          const float complex *u,
+                                                float complex **y, int Y,
+                                                float complex **z)
+{
+    const int N = omp_get_max_threads();
+    const int H = (opt & TRANSPOSE) ? d->w : d->h;
+
+    img e = *d;
+    int r, c, h, w;
+
+    if (Y > 1)
+    {
+        place(d, opt, b, H, 0, &r, &c, &h, &w);
+
+        if (!imgpost(d, r, c, h, w, y[0], false, 1))
+            return await(Y, false);
+    }
+
+    for (int k = 0, s = 0; k < H; k += b, s++)
+    {
+        const int j = s % Y;
+        const int n = min(b, H - k);
+        int       i;
+
+        if (Y > 1)
+        {
+            const int t = (s + 1) % Y;
+
+            if (!imgwait(j + 1))
+                return await(Y, false);
+
+            if (k + b < H)
+            {
+                place(d, opt, b, H, k + b, &r, &c, &h, &w);
+
+                if (!imgwait(t + 1) ||
+                    !imgpost(d, r, c, h, w, y[t], false, t + 1))
+                    return await(Y, false);
+            }
+            place(d, opt, b, H, k, &r, &c, &h, &w);
+        }
+        else
+        {
+            place(d, opt, b, H, k, &r, &c, &h, &w);
+
+            if (!imgload(d, r, c, h, w, y[0]))
+                return false;
+
+            if (opt & TRANSPOSE)
+                imgfetch(d, 0, k + b, d->h, b);
+            else
+                imgfetch(d, k + b, 0, b, d->w);
+        }
+
+        e.a = y[j];
+        e.h = h;
+        e.w = w;
+
+        #pragma omp parallel for schedule(static, max(1, n / N))
+        for (i = 0; i < n; i++)
+            dorow(&e, i, k, opt, f, v, u, z[omp_get_thread_num()]);
+
+        if (Y > 1)
+        {
+            if (!imgpost(d, r, c, h, w, y[j], true, j + 1))
+                return await(Y, false);
+        }
+        else
+        {
+            if (!imgstore(d, r, c, h, w, y[0]))
+                return false;
+        }
+    }
+    return await(Y, true);
+}
+
+// Find an earlier pass among the first k whose lines have the same length as
+// pass k, and whose tables it may therefore share.
+
+static int share(const int *w, int k)
+{
+    for (int j = 0; j < k; j++)
+        if (w[j] == w[k])
+            return j;
+    return -1;
+}
+
+// Transform the image in the K passes with options o. Every pass shares one
+// thread team and the scratch row of each thread, allocated by that thread so
+// that it is local to it, and passes along lines of equal length share tables.
+// Every tile column depends upon every tile row, so the implicit barrier
+// between the passes is the only synchronization. Each line of each pass is
+// given to hook f, if any. The final pass tallies every tile, keeping the image
+// index current, and the image domain follows the passes.
+//
+// Given a nonzero memory budget B, work out-of-core: size the slabs of each
+// pass to the most rows of tiles that fit in what remains of B after the
+// scratch buffers, and move them with explicit I/O. Where what remains holds
+// three slabs of at least one row for every pass, split it three ways so that
+// I/O overlaps the transform.
+
+bool dftpass(img *d, int K, const int *opt, size_t B, const dfthook *f)
+{
+    int            o[DFT_PASSES];
+    int            w[DFT_PASSES];
+    int            h[DFT_PASSES];
+    int            b[DFT_PASSES];
+    int           *v[DFT_PASSES] = { NULL };
+    float complex *u[DFT_PASSES] = { NULL };
+    float complex *y[DFT_SLABS]  = { NULL };
+
+    size_t N = omp_get_max_threads();
+    size_t M = 0;
+    size_t L = 0;
+    int    Y = DFT_SLABS;
+    bool  ok = true;
+    int    j;
+    int    k;
+
+    // The autosort FFT needs no bit reversal table but does need a scratch row.
+    // Batched transforms are autosorted too, and need a scratch row per line of
+    // the batch, as do passes that RETURN, which need their spectra in order.
+    // Lengths that are not powers of two always go by the mixed-radix FFT, with
+    // its own tables and possibly a longer scratch row.
+
+    for (k = 0; k < K; k++)
+    {
+        o[k] = opt[k] | (k == K - 1 ? TALLY : 0);
+
+        if (o[k] & (BATCH | RETURN))
+            o[k] |= AUTOSORT;
+
+        w[k] = (o[k] & TRANSPOSE) ? d->h : d->w;
+        h[k] = (o[k] & TRANSPOSE) ? d->w : d->h;
+
+        const int    l = d->s * w[k];
+        const int    c = batch(d->s, l, d->p, o[k]);
+        const size_t R = !ispow2(l)          ? mixsize(l)
+                       : c                   ? (size_t) c * l
+                       : (o[k] & AUTOSORT)   ? l : 0;
+
+        if ((j = share(w, k)) >= 0)
+        {
+            v[k] = v[j];
+            u[k] = u[j];
+        }
+        else if (!ispow2(l))
+            ok = ok && (u[k] = mixalloc(l));
+        else
+            ok = ok && (u[k] = twialloc(l));
+
+        if (ok && ispow2(l) && !(o[k] & AUTOSORT) && v[k] == NULL)
+        {
+            ok = (v[k] = revalloc(l));
+
+            for (j = 0; j < k; j++)
+                if (w[j] == w[k])
+                    v[j] = v[k];
+        }
+
+        M = max(M, (size_t) d->p * d->s * l + R);
+    }
+
+    // Size the slabs to the budget, in units of one row of tiles.
+
+    if (ok && B)
+    {
+        const size_t R = N * M * sizeof (float complex);
+
+        for (k = 0; k < K; k++)
+        {
+            size_t S = imgsize(d->k) * d->t * w[k];
+
+            if (B < R || (B - R) / (DFT_SLABS * S) == 0)
+                Y = 1;
+        }
+
+        for (k = 0; ok && k < K; k++)
+        {
+            size_t S = imgsize(d->k) * d->t * w[k];
+
+            b[k] = (B > R) ? (int) min((B - R) / (Y * S), (size_t) h[k]) : 0;
+
+            if (b[k])
+                L = max(L, b[k] * S);
+            else
+            {
+                apperr("Budget is less than the %zu bytes needed", R + S);
+                ok = false;
+            }
+        }
+        for (j = 0; ok && j < Y; j++)
+            ok = (y[j] = (float complex *) imgalloc(L));
+    }
+
+    float complex **z;
+
+    if (ok && (z = (float complex **) imgallocs(M * sizeof (float complex))))
+    {
+        if (B)
+        {
+            for (k = 0; ok && k < K; k++)
+                ok = slab(d, o[k], b[k], f, v[k], u[k], y, Y, z);
+        }
+        else
+        {
+            #pragma omp parallel private(k)
+            {
+                float complex *t = z[omp_get_thread_num()];
+                int            i;
+
+                for (k = 0; k < K; k++)
+                {
+                    #pragma omp single
+                    imghint(d, (o[k] & TRANSPOSE) ? IMG_RANDOM : IMG_SEQUENTIAL);
+
+                    #pragma omp for schedule(static, max(1, h[k] / N))
+                    for (i = 0; i < h[k]; i++)
+                    {
+                        fetch(d, o[k], i + 1);
+                        dorow(d, i, 0, o[k], f, v[k], u[k], t);
+                    }
+                }
+            }
+            imghint(d, IMG_NORMAL);
+        }
+        imgfrees((void **) z, M * sizeof (float complex));
+    }
+    else ok = false;
+
+    for (k = 0; k < K; k++)
+        if (share(w, k) < 0)
+        {
+            free(v[k]);
+            free(u[k]);
+        }
+    for (j = 0; j < DFT_SLABS; j++)
+        imgfree(y[j], L);
+
+    // Note which of the rows and columns are now in the frequency domain.
+
+    for (k = 0; ok && k < K; k++)
+        if (!(o[k] & RETURN))
+        {
+            const int e = (o[k] & TRANSPOSE) ? IMG_COLS : IMG_ROWS;
+
+            d->e = (o[k] & INVERSE) ? (d->e & ~e) : (d->e | e);
+        }
+
+    return ok;
+}
+
+// Transform the image in one pass, or in two passes if opt includes TWOD. A
+// 2D forward transform goes row-wise then column-wise, and the inverse goes
+// column-wise then row-wise, so that a real inverse ends with the real pass.
+// Hook f, if given, sees every line of every pass.
+
+bool dft(img *d, int opt, size_t B, const dfthook *f)
+{
+    int o[2];
+
+    if (opt & TWOD)
+        o[0] = (opt & INVERSE) ? (opt | TRANSPOSE) : (opt & ~TRANSPOSE);
+    else
+        o[0] = opt;
+
+    o[1] = o[0] ^ TRANSPOSE;
+
+    return dftpass(d, (opt & TWOD) ? 2 : 1, o, B, f);
+}
+
+//------------------------------------------------------------------------------
+
+// FFT variants, numbered as in the wisdom file: bit-reversed, autosort, and
+// batched autosort.
+
+int dftvariant(int s)
+{
+    static const int variant[] = { 0, AUTOSORT, BATCH };
+
+    return (0 <= s && s < DFT_VARIANTS) ? variant[s] : 0;
+}
+
+// Without an explicit tile size, take the FFT variant and thread count for an
+// image of the given size from wisdom, unless the thread count is set in the
+// environment. Return the option flags of the variant.
+
+int dftwisdom(int l, int n, int m, int p)
+{
+    int s = 0;
+    int t = 0;
+
+    if (l < 0 && wisget(n, m, p, NULL, &s, &t))
+    {
+        if (t > 0 && getenv("OMP_NUM_THREADS") == NULL)
+            omp_set_num_threads(t);
+
+        return dftvariant(s);
+    }
+    return 0;
+}
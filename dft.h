@@ -0,0 +1,88 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_DFT_H
+#define GIGO_DFT_H
+
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "img.h"
+
+//------------------------------------------------------------------------------
+
+enum dftopt
+{
+    INVERSE   =   1,
+    TRANSPOSE =   2,
+    AUTOSORT  =   4,
+    REAL      =   8,
+    TWOD      =  16,
+    PLAN      =  32,
+    BATCH     =  64,
+    RETURN    = 128,
+};
+
+#define DFT_PASSES 3
+#define DFT_SLABS  3
+
+// The planner chooses among the FFT variants in place, autosort, and batched.
+
+#define DFT_VARIANTS 3
+
+//------------------------------------------------------------------------------
+
+// A forward transform places frequency x of a line of length n at index
+// dftpos(x, n), with the DC term at the center. dftfreq gives the reverse.
+
+static inline int dftpos(int x, int n)
+{
+    return (x + n / 2) % n;
+}
+
+static inline int dftfreq(int x, int n)
+{
+    return (x + n - n / 2) % n;
+}
+
+//------------------------------------------------------------------------------
+
+// A hook sees every line of every pass after it is transformed and before it
+// is written back, with the options of that pass. Line y of channel k is the
+// image row (or column, if transposed) y, and its m samples are s apart. The
+// samples of a forward transform are in frequency order, unshifted. A pass
+// with the RETURN option transforms each line, hooks it, and transforms it
+// back again, so that the hook may work in the frequency domain while the
+// image remains in the spatial domain throughout. Hooks are called from many
+// threads at once.
+
+struct dfthook
+{
+    void (*f)(void *data, int opt, int y, int k,
+              float complex *z, int s, int m);
+    void  *data;
+};
+
+typedef struct dfthook dfthook;
+
+//------------------------------------------------------------------------------
+
+bool dftpass(img *d, int K, const int *o, size_t B, const dfthook *f);
+bool dft    (img *d, int opt, size_t B, const dfthook *f);
+
+int  dftvariant(int s);
+int  dftwisdom (int l, int n, int m, int p);
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -15,6 +15,7 @@
 
 #include <complex.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -68,6 +69,24 @@ static inline bool isext(const char *arg, const char *ext)
         return (strcmp(arg + arglen - extlen, ext) == 0);
 }
 
+// Parse a byte count with an optional binary K, M, G, or T suffix. Return zero
+// if the argument is malformed.
+
+static inline size_t strtosize(const char *arg)
+{
+    char  *end;
+    size_t n = (size_t) strtoull(arg, &end, 0);
+
+    switch (*end)
+    {
+        case 'T': case 't': n <<= 10;
+        case 'G': case 'g': n <<= 10;
+        case 'M': case 'm': n <<= 10;
+        case 'K': case 'k': n <<= 10; end++;
+    }
+    return (end == arg || *end) ? 0 : n;
+}
+
 //------------------------------------------------------------------------------
 
 static inline long long min(long long a, long long b)
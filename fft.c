@@ -12,9 +12,11 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <complex.h>
 
 #include "etc.h"
+#include "vec.h"
 
 //------------------------------------------------------------------------------
 
@@ -44,31 +46,914 @@ int *revalloc(int n)
     return x;
 }
 
-// Apply the Fast Fourier Transform in place in v[0..n]. If s is -1 then
+//------------------------------------------------------------------------------
+
+// Radix-4 passes operate on blocks of 4M values. If log2 n is even then M runs
+// 1, 4, 16... Otherwise a single radix-2 pass goes first and M runs 2, 8, 32...
+
+static inline int first(int n)
+{
+    return (log2i(n) & 1) ? 2 : 1;
+}
+
+// Allocate and initialize the twiddle factors for an FFT of length n. Each
+// radix-4 pass M receives three consecutive arrays giving w^m, w^2m, and w^3m
+// for m in [0, M) where w = e^(2 pi i / 4M). Passes are stored in increasing
+// order of M, so pass M begins at offset M - first(n). These are computed in
+// double precision once and are then shared read-only by all threads.
+
+float complex *twialloc(int n)
+{
+    float complex *w;
+
+    if ((w = (float complex *) malloc(max(n, 1) * sizeof (float complex))))
+    {
+        const int M0 = first(n);
+
+        for (int M = M0; M < n; M *= 4)
+        {
+            float complex *w1 = w + M - M0;
+            float complex *w2 = w1 + M;
+            float complex *w3 = w2 + M;
+
+            for (int m = 0; m < M; m++)
+            {
+                const double a = 2.0 * M_PI * m / (4.0 * M);
+
+                w1[m] = (float) cos(1.0 * a) + I * (float) sin(1.0 * a);
+                w2[m] = (float) cos(2.0 * a) + I * (float) sin(2.0 * a);
+                w3[m] = (float) cos(3.0 * a) + I * (float) sin(3.0 * a);
+            }
+        }
+    }
+    return w;
+}
+
+// Apply one radix-4 pass combining four DFTs of length M into one of length
+// 4M, for each block of 4M values in v[0..n]. Given bit-reversed input, these
+// are the DFTs of the subsequences 4k + 0, 4k + 2, 4k + 1, and 4k + 3, in that
+// order. The inverse conjugates the twiddle factors and rotates by -j instead
+// of j.
+//
+// The scalar butterflies operate on the real and imaginary parts directly, as
+// C99 complex multiplication carries a NaN check that dominates the loop.
+
+static void pass(int s, int n, int M, const float *w1,
+                                      const float *w2,
+                                      const float *w3, float *v)
+{
+    for     (int b = 0; b < n; b += 4 * M)
+        for (int m = 0; m < M; m++)
+        {
+            float *u0 = v + 2 * (b + m);
+            float *u1 = u0 + 2 * M;
+            float *u2 = u1 + 2 * M;
+            float *u3 = u2 + 2 * M;
+
+            const float k1r = w1[2 * m], k1i = s * w1[2 * m + 1];
+            const float k2r = w2[2 * m], k2i = s * w2[2 * m + 1];
+            const float k3r = w3[2 * m], k3i = s * w3[2 * m + 1];
+
+            const float t0r = u0[0];
+            const float t0i = u0[1];
+            const float t1r = k2r * u1[0] - k2i * u1[1];
+            const float t1i = k2r * u1[1] + k2i * u1[0];
+            const float t2r = k1r * u2[0] - k1i * u2[1];
+            const float t2i = k1r * u2[1] + k1i * u2[0];
+            const float t3r = k3r * u3[0] - k3i * u3[1];
+            const float t3i = k3r * u3[1] + k3i * u3[0];
+
+            const float a0r = t0r + t1r, a0i = t0i + t1i;
+            const float a1r = t0r - t1r, a1i = t0i - t1i;
+            const float a2r = t2r + t3r, a2i = t2i + t3i;
+            const float a3r = s * (t3i - t2i);
+            const float a3i = s * (t2r - t3r);
+
+            u0[0] = a0r + a2r; u0[1] = a0i + a2i;
+            u1[0] = a1r + a3r; u1[1] = a1i + a3i;
+            u2[0] = a0r - a2r; u2[1] = a0i - a2i;
+            u3[0] = a1r - a3r; u3[1] = a1i - a3i;
+        }
+}
+
+// The vector passes perform the same butterflies on 2, 4, or 8 consecutive
+// values of m at once, and so require M to be a multiple of the vector width.
+// Mask c conjugates the twiddle factors of the inverse. Mask r negates one
+// half of a swapped complex value, giving multiplication by j or -j.
+
+#ifdef GIGO_X86
+
+static TARGET_SSE2 void pass128(int s, int n, int M, const float *w1,
+                                                     const float *w2,
+                                                     const float *w3, float *v)
+{
+    const __m128 c = (s > 0) ? _mm_setzero_ps()
+                             : _mm_set_ps(-0.f, 0.f, -0.f, 0.f);
+    const __m128 r = (s > 0) ? _mm_set_ps(0.f, -0.f, 0.f, -0.f)
+                             : _mm_set_ps(-0.f, 0.f, -0.f, 0.f);
+
+    for     (int b = 0; b < n; b += 4 * M)
+        for (int m = 0; m < M; m += 2)
+        {
+            float *u0 = v + 2 * (b + m);
+            float *u1 = u0 + 2 * M;
+            float *u2 = u1 + 2 * M;
+            float *u3 = u2 + 2 * M;
+
+            const __m128 k1 = _mm_xor_ps(_mm_loadu_ps(w1 + 2 * m), c);
+            const __m128 k2 = _mm_xor_ps(_mm_loadu_ps(w2 + 2 * m), c);
+            const __m128 k3 = _mm_xor_ps(_mm_loadu_ps(w3 + 2 * m), c);
+
+            const __m128 t0 =          _mm_loadu_ps(u0);
+            const __m128 t1 = cmul128(_mm_loadu_ps(u1), k2);
+            const __m128 t2 = cmul128(_mm_loadu_ps(u2), k1);
+            const __m128 t3 = cmul128(_mm_loadu_ps(u3), k3);
+
+            const __m128 a0 = _mm_add_ps(t0, t1);
+            const __m128 a1 = _mm_sub_ps(t0, t1);
+            const __m128 a2 = _mm_add_ps(t2, t3);
+            const __m128 d3 = _mm_sub_ps(t2, t3);
+            const __m128 a3 = _mm_xor_ps(_mm_shuffle_ps(d3, d3,
+                                         _MM_SHUFFLE(2, 3, 0, 1)), r);
+
+            _mm_storeu_ps(u0, _mm_add_ps(a0, a2));
+            _mm_storeu_ps(u1, _mm_add_ps(a1, a3));
+            _mm_storeu_ps(u2, _mm_sub_ps(a0, a2));
+            _mm_storeu_ps(u3, _mm_sub_ps(a1, a3));
+        }
+}
+
+static TARGET_AVX2 void pass256(int s, int n, int M, const float *w1,
+                                                     const float *w2,
+                                                     const float *w3, float *v)
+{
+    const __m256 c = (s > 0) ? _mm256_setzero_ps()
+                             : _mm256_set_ps(-0.f, 0.f, -0.f, 0.f,
+                                             -0.f, 0.f, -0.f, 0.f);
+    const __m256 r = (s > 0) ? _mm256_set_ps(0.f, -0.f, 0.f, -0.f,
+                                             0.f, -0.f, 0.f, -0.f)
+                             : _mm256_set_ps(-0.f, 0.f, -0.f, 0.f,
+                                             -0.f, 0.f, -0.f, 0.f);
+
+    for     (int b = 0; b < n; b += 4 * M)
+        for (int m = 0; m < M; m += 4)
+        {
+            float *u0 = v + 2 * (b + m);
+            float *u1 = u0 + 2 * M;
+            float *u2 = u1 + 2 * M;
+            float *u3 = u2 + 2 * M;
+
+            const __m256 k1 = _mm256_xor_ps(_mm256_loadu_ps(w1 + 2 * m), c);
+            const __m256 k2 = _mm256_xor_ps(_mm256_loadu_ps(w2 + 2 * m), c);
+            const __m256 k3 = _mm256_xor_ps(_mm256_loadu_ps(w3 + 2 * m), c);
+
+            const __m256 t0 =          _mm256_loadu_ps(u0);
+            const __m256 t1 = cmul256(_mm256_loadu_ps(u1), k2);
+            const __m256 t2 = cmul256(_mm256_loadu_ps(u2), k1);
+            const __m256 t3 = cmul256(_mm256_loadu_ps(u3), k3);
+
+            const __m256 a0 = _mm256_add_ps(t0, t1);
+            const __m256 a1 = _mm256_sub_ps(t0, t1);
+            const __m256 a2 = _mm256_add_ps(t2, t3);
+            const __m256 d3 = _mm256_sub_ps(t2, t3);
+            const __m256 a3 = _mm256_xor_ps(_mm256_permute_ps(d3,
+                                            _MM_SHUFFLE(2, 3, 0, 1)), r);
+
+            _mm256_storeu_ps(u0, _mm256_add_ps(a0, a2));
+            _mm256_storeu_ps(u1, _mm256_add_ps(a1, a3));
+            _mm256_storeu_ps(u2, _mm256_sub_ps(a0, a2));
+            _mm256_storeu_ps(u3, _mm256_sub_ps(a1, a3));
+        }
+}
+
+static TARGET_AVX512 void pass512(int s, int n, int M, const float *w1,
+                                                       const float *w2,
+                                                       const float *w3, float *v)
+{
+    const __m512 e = _mm512_set_ps(0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f,
+                                   0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f);
+    const __m512 o = _mm512_set_ps(-0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f,
+                                   -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f);
+    const __m512 c = (s > 0) ? _mm512_setzero_ps() : o;
+    const __m512 r = (s > 0) ? e : o;
+
+    for     (int b = 0; b < n; b += 4 * M)
+        for (int m = 0; m < M; m += 8)
+        {
+            float *u0 = v + 2 * (b + m);
+            float *u1 = u0 + 2 * M;
+            float *u2 = u1 + 2 * M;
+            float *u3 = u2 + 2 * M;
+
+            const __m512 k1 = xor512(_mm512_loadu_ps(w1 + 2 * m), c);
+            const __m512 k2 = xor512(_mm512_loadu_ps(w2 + 2 * m), c);
+            const __m512 k3 = xor512(_mm512_loadu_ps(w3 + 2 * m), c);
+
+            const __m512 t0 =          _mm512_loadu_ps(u0);
+            const __m512 t1 = cmul512(_mm512_loadu_ps(u1), k2);
+            const __m512 t2 = cmul512(_mm512_loadu_ps(u2), k1);
+            const __m512 t3 = cmul512(_mm512_loadu_ps(u3), k3);
+
+            const __m512 a0 = _mm512_add_ps(t0, t1);
+            const __m512 a1 = _mm512_sub_ps(t0, t1);
+            const __m512 a2 = _mm512_add_ps(t2, t3);
+            const __m512 d3 = _mm512_sub_ps(t2, t3);
+            const __m512 a3 = xor512(_mm512_permute_ps(d3,
+                                     _MM_SHUFFLE(2, 3, 0, 1)), r);
+
+            _mm512_storeu_ps(u0, _mm512_add_ps(a0, a2));
+            _mm512_storeu_ps(u1, _mm512_add_ps(a1, a3));
+            _mm512_storeu_ps(u2, _mm512_sub_ps(a0, a2));
+            _mm512_storeu_ps(u3, _mm512_sub_ps(a1, a3));
+        }
+}
+
+#endif
+
+// Apply the Fast Fourier Transform in place in v[0..n] using the twiddle
+// factors w given by twialloc(n). The input must be in bit-reversed order. If
+// s is -1 then apply the inverse. Each pass uses the widest vectors that fit.
+
+void fft(int s, int n, const float complex *w, float complex *v)
+{
+    const int M0 = first(n);
+#ifdef GIGO_X86
+    const int is = vecisa();
+#endif
+    float *V = (float *) v;
+
+    // Begin with a radix-2 pass if necessary. Its twiddle factors are all one.
+
+    if (M0 == 2)
+        for (int i = 0; i < n; i += 2)
+        {
+            const float complex t = v[i + 1];
+            v[i + 1] = v[i] - t;
+            v[i    ] = v[i] + t;
+        }
+
+    // Follow with the radix-4 passes.
+
+    for (int M = M0; M < n; M *= 4)
+    {
+        const float *w1 = (const float *) (w + M - M0);
+        const float *w2 = w1 + 2 * M;
+        const float *w3 = w2 + 2 * M;
+#ifdef GIGO_X86
+        if      (is >= ISA_AVX512 && M >= 8) pass512(s, n, M, w1, w2, w3, V);
+        else if (is >= ISA_AVX2   && M >= 4) pass256(s, n, M, w1, w2, w3, V);
+        else if (is >= ISA_SSE2   && M >= 2) pass128(s, n, M, w1, w2, w3, V);
+        else
+#endif
+                                             pass   (s, n, M, w1, w2, w3, V);
+    }
+
+    if (s < 0)
+    {
+        const float k = 1.0f / n;
+
+        for (int i = 0; i < 2 * n; ++i)
+            V[i] = V[i] * k;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Apply one radix-4 Stockham pass, reading x and writing y. This decimates a
+// set of S interleaved DFTs of length 4M into 4S interleaved DFTs of length M.
+// The twiddle factors of pass M are shared with the in-place transform above.
+// Inputs and outputs are both walked sequentially, q being the inner index.
+
+static void spass(int s, int M, int S, const float *w1,
+                                       const float *w2,
+                                       const float *w3, const float *x, float *y)
+{
+    const int o = 2 * S * M;
+
+    for     (int p = 0; p < M; p++)
+    {
+        const float k1r = w1[2 * p], k1i = s * w1[2 * p + 1];
+        const float k2r = w2[2 * p], k2i = s * w2[2 * p + 1];
+        const float k3r = w3[2 * p], k3i = s * w3[2 * p + 1];
+
+        for (int q = 0; q < S; q++)
+        {
+            const float *a = x + 2 * (q + S * p);
+            float       *b = y + 2 * (q + S * p * 4);
+
+            const float apcr = a[0] + a[2 * o], apci = a[1] + a[2 * o + 1];
+            const float amcr = a[0] - a[2 * o], amci = a[1] - a[2 * o + 1];
+            const float bpdr = a[o] + a[3 * o], bpdi = a[o + 1] + a[3 * o + 1];
+            const float jbdr = s * (a[3 * o + 1] - a[o + 1]);
+            const float jbdi = s * (a[o] - a[3 * o]);
+
+            const float y1r = amcr + jbdr, y1i = amci + jbdi;
+            const float y2r = apcr - bpdr, y2i = apci - bpdi;
+            const float y3r = amcr - jbdr, y3i = amci - jbdi;
+
+            b[0        ] = apcr + bpdr;
+            b[1        ] = apci + bpdi;
+            b[2 * S    ] = k1r * y1r - k1i * y1i;
+            b[2 * S + 1] = k1r * y1i + k1i * y1r;
+            b[4 * S    ] = k2r * y2r - k2i * y2i;
+            b[4 * S + 1] = k2r * y2i + k2i * y2r;
+            b[6 * S    ] = k3r * y3r - k3i * y3i;
+            b[6 * S + 1] = k3r * y3i + k3i * y3r;
+        }
+    }
+}
+
+// The vector Stockham passes broadcast each twiddle factor across the inner
+// loop, and so require S to be a multiple of the vector width.
+
+#ifdef GIGO_X86
+
+static TARGET_SSE2 void spass128(int s, int M, int S, const float *w1,
+                                                      const float *w2,
+                                                      const float *w3,
+                                                      const float *x, float *y)
+{
+    const __m128 r = (s > 0) ? _mm_set_ps(0.f, -0.f, 0.f, -0.f)
+                             : _mm_set_ps(-0.f, 0.f, -0.f, 0.f);
+    const int    o = 2 * S * M;
+
+    for     (int p = 0; p < M; p++)
+    {
+        const __m128 k1 = _mm_set_ps(s * w1[2 * p + 1], w1[2 * p],
+                                     s * w1[2 * p + 1], w1[2 * p]);
+        const __m128 k2 = _mm_set_ps(s * w2[2 * p + 1], w2[2 * p],
+                                     s * w2[2 * p + 1], w2[2 * p]);
+        const __m128 k3 = _mm_set_ps(s * w3[2 * p + 1], w3[2 * p],
+                                     s * w3[2 * p + 1], w3[2 * p]);
+
+        for (int q = 0; q < S; q += 2)
+        {
+            const float *a = x + 2 * (q + S * p);
+            float       *b = y + 2 * (q + S * p * 4);
+
+            const __m128 a0 = _mm_loadu_ps(a);
+            const __m128 a1 = _mm_loadu_ps(a + o);
+            const __m128 a2 = _mm_loadu_ps(a + o * 2);
+            const __m128 a3 = _mm_loadu_ps(a + o * 3);
+
+            const __m128 apc = _mm_add_ps(a0, a2);
+            const __m128 amc = _mm_sub_ps(a0, a2);
+            const __m128 bpd = _mm_add_ps(a1, a3);
+            const __m128 bmd = _mm_sub_ps(a1, a3);
+            const __m128 jbd = _mm_xor_ps(_mm_shuffle_ps(bmd, bmd,
+                                          _MM_SHUFFLE(2, 3, 0, 1)), r);
+
+            _mm_storeu_ps(b,         _mm_add_ps(apc, bpd));
+            _mm_storeu_ps(b + 2 * S, cmul128(_mm_add_ps(amc, jbd), k1));
+            _mm_storeu_ps(b + 4 * S, cmul128(_mm_sub_ps(apc, bpd), k2));
+            _mm_storeu_ps(b + 6 * S, cmul128(_mm_sub_ps(amc, jbd), k3));
+        }
+    }
+}
+
+static TARGET_AVX2 void spass256(int s, int M, int S, const float *w1,
+                                                      const float *w2,
+                                                      const float *w3,
+                                                      const float *x, float *y)
+{
+    const __m256 r = (s > 0) ? _mm256_set_ps(0.f, -0.f, 0.f, -0.f,
+                                             0.f, -0.f, 0.f, -0.f)
+                             : _mm256_set_ps(-0.f, 0.f, -0.f, 0.f,
+                                             -0.f, 0.f, -0.f, 0.f);
+    const int    o = 2 * S * M;
+
+    for     (int p = 0; p < M; p++)
+    {
+        const float  i1 = s * w1[2 * p + 1], r1 = w1[2 * p];
+        const float  i2 = s * w2[2 * p + 1], r2 = w2[2 * p];
+        const float  i3 = s * w3[2 * p + 1], r3 = w3[2 * p];
+        const __m256 k1 = _mm256_set_ps(i1, r1, i1, r1, i1, r1, i1, r1);
+        const __m256 k2 = _mm256_set_ps(i2, r2, i2, r2, i2, r2, i2, r2);
+        const __m256 k3 = _mm256_set_ps(i3, r3, i3, r3, i3, r3, i3, r3);
+
+        for (int q = 0; q < S; q += 4)
+        {
+            const float *a = x + 2 * (q + S * p);
+            float       *b = y + 2 * (q + S * p * 4);
+
+            const __m256 a0 = _mm256_loadu_ps(a);
+            const __m256 a1 = _mm256_loadu_ps(a + o);
+            const __m256 a2 = _mm256_loadu_ps(a + o * 2);
+            const __m256 a3 = _mm256_loadu_ps(a + o * 3);
+
+            const __m256 apc = _mm256_add_ps(a0, a2);
+            const __m256 amc = _mm256_sub_ps(a0, a2);
+            const __m256 bpd = _mm256_add_ps(a1, a3);
+            const __m256 bmd = _mm256_sub_ps(a1, a3);
+            const __m256 jbd = _mm256_xor_ps(_mm256_permute_ps(bmd,
+                                             _MM_SHUFFLE(2, 3, 0, 1)), r);
+
+            _mm256_storeu_ps(b,         _mm256_add_ps(apc, bpd));
+            _mm256_storeu_ps(b + 2 * S, cmul256(_mm256_add_ps(amc, jbd), k1));
+            _mm256_storeu_ps(b + 4 * S, cmul256(_mm256_sub_ps(apc, bpd), k2));
+            _mm256_storeu_ps(b + 6 * S, cmul256(_mm256_sub_ps(amc, jbd), k3));
+        }
+    }
+}
+
+static TARGET_AVX512 void spass512(int s, int M, int S, const float *w1,
+                                                        const float *w2,
+                                                        const float *w3,
+                                                        const float *x, float *y)
+{
+    const __m512 e = _mm512_set_ps(0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f,
+                                   0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f);
+    const __m512 d = _mm512_set_ps(-0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f,
+                                   -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f);
+    const __m512 r = (s > 0) ? e : d;
+    const int    o = 2 * S * M;
+
+    for     (int p = 0; p < M; p++)
+    {
+        const float  i1 = s * w1[2 * p + 1], r1 = w1[2 * p];
+        const float  i2 = s * w2[2 * p + 1], r2 = w2[2 * p];
+        const float  i3 = s * w3[2 * p + 1], r3 = w3[2 * p];
+        const __m512 k1 = _mm512_set_ps(i1, r1, i1, r1, i1, r1, i1, r1,
+                                        i1, r1, i1, r1, i1, r1, i1, r1);
+        const __m512 k2 = _mm512_set_ps(i2, r2, i2, r2, i2, r2, i2, r2,
+                                        i2, r2, i2, r2, i2, r2, i2, r2);
+        const __m512 k3 = _mm512_set_ps(i3, r3, i3, r3, i3, r3, i3, r3,
+                                        i3, r3, i3, r3, i3, r3, i3, r3);
+
+        for (int q = 0; q < S; q += 8)
+        {
+            const float *a = x + 2 * (q + S * p);
+            float       *b = y + 2 * (q + S * p * 4);
+
+            const __m512 a0 = _mm512_loadu_ps(a);
+            const __m512 a1 = _mm512_loadu_ps(a + o);
+            const __m512 a2 = _mm512_loadu_ps(a + o * 2);
+            const __m512 a3 = _mm512_loadu_ps(a + o * 3);
+
+            const __m512 apc = _mm512_add_ps(a0, a2);
+            const __m512 amc = _mm512_sub_ps(a0, a2);
+            const __m512 bpd = _mm512_add_ps(a1, a3);
+            const __m512 bmd = _mm512_sub_ps(a1, a3);
+            const __m512 jbd = xor512(_mm512_permute_ps(bmd,
+                                      _MM_SHUFFLE(2, 3, 0, 1)), r);
+
+            _mm512_storeu_ps(b,         _mm512_add_ps(apc, bpd));
+            _mm512_storeu_ps(b + 2 * S, cmul512(_mm512_add_ps(amc, jbd), k1));
+            _mm512_storeu_ps(b + 4 * S, cmul512(_mm512_sub_ps(apc, bpd), k2));
+            _mm512_storeu_ps(b + 6 * S, cmul512(_mm512_sub_ps(amc, jbd), k3));
+        }
+    }
+}
+
+#endif
+
+// Apply the Fast Fourier Transform in place to b interleaved sequences of
+// length n, element j of sequence k being v[j * b + k], using the twiddle
+// factors w given by twialloc(n) and scratch space t[0..n * b]. As a Stockham
+// pass already treats its S interleaved DFTs alike, this is simply a start at
+// S = b. The inner loop then runs across sequences, so every pass uses full
+// vectors once b is a multiple of the vector width, whatever the value of n.
+
+void batchfft(int s, int n, int b, const float complex *w, float complex *v,
+                                                           float complex *t)
+{
+    const int M0 = first(n);
+#ifdef GIGO_X86
+    const int is = vecisa();
+#endif
+    float *x = (float *) v;
+    float *y = (float *) t;
+    float *z;
+    int    S = b;
+
+    // Apply radix-4 passes from the full length downward.
+
+    for (int M = n / 4; M >= M0; M /= 4, S *= 4)
+    {
+        const float *w1 = (const float *) (w + M - M0);
+        const float *w2 = w1 + 2 * M;
+        const float *w3 = w2 + 2 * M;
+#ifdef GIGO_X86
+        if      (is >= ISA_AVX512 && S % 8 == 0)
+            spass512(s, M, S, w1, w2, w3, x, y);
+        else if (is >= ISA_AVX2   && S % 4 == 0)
+            spass256(s, M, S, w1, w2, w3, x, y);
+        else if (is >= ISA_SSE2   && S % 2 == 0)
+            spass128(s, M, S, w1, w2, w3, x, y);
+        else
+#endif
+            spass   (s, M, S, w1, w2, w3, x, y);
+        z = x;
+        x = y;
+        y = z;
+    }
+
+    // Finish with a radix-2 pass if necessary. Its twiddle factors are all one.
+
+    if (M0 == 2)
+    {
+        for (int q = 0; q < 2 * S; q++)
+        {
+            y[q        ] = x[q] + x[q + 2 * S];
+            y[q + 2 * S] = x[q] - x[q + 2 * S];
+        }
+        z = x;
+        x = y;
+        y = z;
+    }
+
+    // Move the result back to v if it ended up in t.
+
+    if (x != (float *) v)
+    {
+        memcpy(v, x, (size_t) n * b * sizeof (float complex));
+        x = (float *) v;
+    }
+
+    if (s < 0)
+    {
+        const float k = 1.0f / n;
+
+        for (size_t i = 0; i < 2 * (size_t) n * b; ++i)
+            x[i] = x[i] * k;
+    }
+}
+
+// Apply the Fast Fourier Transform in place in v[0..n] using the twiddle
+// factors w given by twialloc(n) and scratch space t[0..n]. Unlike fft(),
+// input and output are both in natural order, as the Stockham formulation
+// sorts the data as it goes, ping-ponging between v and t. If s is -1 then
 // apply the inverse.
 
-void fft(int s, int n, float complex *v)
+void stockham(int s, int n, const float complex *w, float complex *v,
+                                                    float complex *t)
+{
+    batchfft(s, n, 1, w, v, t);
+}
+
+//------------------------------------------------------------------------------
+
+// Lengths that are not powers of two are factored into radices 4, 2, 3, 5, and
+// 7, in that order, and transformed by mixed-radix Stockham passes. Lengths
+// with any larger prime factor go by way of Bluestein's algorithm, which gives
+// the DFT as a convolution of power-of-two length L >= 2n - 1.
+
+static bool factor(int n, int *f, int *k)
+{
+    static const int r[] = { 4, 2, 3, 5, 7 };
+
+    *k = 0;
+
+    for (int i = 0; i < 5; i++)
+        while (n % r[i] == 0)
+        {
+            f[(*k)++] = r[i];
+            n        /= r[i];
+        }
+
+    return (n == 1);
+}
+
+static int bluelen(int n)
+{
+    int L = 1;
+
+    while (L < 2 * n - 1)
+        L *= 2;
+
+    return L;
+}
+
+// Return the length of the scratch buffer needed by mixfft.
+
+int mixsize(int n)
+{
+    int f[32], k;
+
+    return factor(n, f, &k) ? n : 2 * bluelen(n);
+}
+
+// Allocate and initialize the tables for a transform of length n. The mixed-
+// radix tables give, for each pass of radix R over DFTs of length S, the R - 1
+// twiddle factors w^rk with w = e^(2 pi i / RS) for each k in [0, S). These sum
+// to n - 1 values. The Bluestein tables give the chirp c[j] = e^(pi i j^2 / n),
+// then the transform of its conjugate wrapped to length L, and then the power-
+// of-two tables of length L.
+
+float complex *mixalloc(int n)
+{
+    float complex *w = NULL;
+    float complex *u = NULL;
+    float complex *t = NULL;
+
+    int f[32], k;
+
+    if (factor(n, f, &k))
+    {
+        if ((w = (float complex *) malloc(max(n, 1) * sizeof (float complex))))
+        {
+            float complex *v = w;
+
+            for (int i = 0, S = 1; i < k; S *= f[i], i++)
+                for     (int q = 0; q < S;    q++)
+                    for (int r = 1; r < f[i]; r++)
+                    {
+                        const double a = 2.0 * M_PI * r * q / (f[i] * S);
+
+                        *v++ = (float) cos(a) + I * (float) sin(a);
+                    }
+        }
+    }
+    else
+    {
+        const int L = bluelen(n);
+
+        if ((w = (float complex *) malloc((n + 2 * L) * sizeof (float complex))))
+        {
+            if ((u = twialloc(L)) && (t = (float complex *)
+                                    malloc(L * sizeof (float complex))))
+            {
+                float complex *c = w;
+                float complex *b = w + n;
+
+                for (int j = 0; j < n; j++)
+                {
+                    const double a = M_PI * (double) ((long long) j * j
+                                                   % (2LL * n)) / n;
+
+                    c[j] = (float) cos(a) + I * (float) sin(a);
+                }
+                for (int j = 0; j < L; j++)
+                    b[j] = 0.0f;
+                for (int j = 0; j < n; j++)
+                    b[j] = conjf(c[j]);
+                for (int j = 1; j < n; j++)
+                    b[L - j] = conjf(c[j]);
+
+                stockham(+1, L, u, b, t);
+
+                memcpy(w + n + L, u, L * sizeof (float complex));
+            }
+            else
+            {
+                free(w);
+                w = NULL;
+            }
+            free(t);
+            free(u);
+        }
+    }
+    return w;
+}
+
+// Apply one mixed-radix Stockham pass of radix R, reading x and writing y. This
+// combines R interleaved sets of DFTs of length S into DFTs of length RS. The
+// butterflies of odd radix pair the terms r and R - r, sharing the cosines.
+
+static void mpass(int s, int n, int R, int S, const float *w,
+                                              const float *x, float *y)
 {
-    for (int M = 1; M < n; M *= 2)
+    const int N = n / R;
+
+    float cr[7];
+    float ci[7];
+    float ar[7];
+    float ai[7];
+
+    for (int r = 0; r < R; r++)
     {
-        float         a = sinf(0.5f * s * M_PI / M);
-        float         b = sinf(       s * M_PI / M);
-        float complex k = -2.0f * a * a + b * I;
-        float complex w =  1.0f;
+        cr[r] =     (float) cos(2.0 * M_PI * r / R);
+        ci[r] = s * (float) sin(2.0 * M_PI * r / R);
+    }
 
-        for (int m = 0; m < M; ++m)
+    for     (int b = 0; b < N; b += S)
+        for (int k = 0; k < S; k++)
         {
-            for (int i = m; i < n; i += M * 2)
+            const float *u = x + 2 * (b + k);
+            const float *v = w + 2 * (R - 1) * k;
+            float       *z = y + 2 * (b * R + k);
+
+            ar[0] = u[0];
+            ai[0] = u[1];
+
+            for (int r = 1; r < R; r++)
+            {
+                const float ur = u[2 * r * N], ui = u[2 * r * N + 1];
+                const float vr = v[2 * r - 2], vi = s * v[2 * r - 1];
+
+                ar[r] = ur * vr - ui * vi;
+                ai[r] = ur * vi + ui * vr;
+            }
+
+            if (R == 2)
+            {
+                z[0    ] = ar[0] + ar[1]; z[1        ] = ai[0] + ai[1];
+                z[2 * S] = ar[0] - ar[1]; z[2 * S + 1] = ai[0] - ai[1];
+            }
+            else if (R == 4)
+            {
+                const float a0r = ar[0] + ar[2], a0i = ai[0] + ai[2];
+                const float a1r = ar[0] - ar[2], a1i = ai[0] - ai[2];
+                const float a2r = ar[1] + ar[3], a2i = ai[1] + ai[3];
+                const float a3r = s * (ai[3] - ai[1]);
+                const float a3i = s * (ar[1] - ar[3]);
+
+                z[0    ] = a0r + a2r; z[1        ] = a0i + a2i;
+                z[2 * S] = a1r + a3r; z[2 * S + 1] = a1i + a3i;
+                z[4 * S] = a0r - a2r; z[4 * S + 1] = a0i - a2i;
+                z[6 * S] = a1r - a3r; z[6 * S + 1] = a1i - a3i;
+            }
+            else
             {
-                float complex t = w * v[i + M];
-                v[i + M] = v[i] - t;
-                v[i    ] = v[i] + t;
+                float tr = ar[0];
+                float ti = ai[0];
+
+                for (int r = 1; r <= R / 2; r++)
+                {
+                    tr += ar[r] + ar[R - r];
+                    ti += ai[r] + ai[R - r];
+                }
+                z[0] = tr;
+                z[1] = ti;
+
+                for (int q = 1; q <= R / 2; q++)
+                {
+                    float pr = ar[0], pi = ai[0];
+                    float mr = 0.0f,  mi = 0.0f;
+
+                    for (int r = 1; r <= R / 2; r++)
+                    {
+                        const int j = q * r % R;
+
+                        pr += cr[j] * (ar[r] + ar[R - r]);
+                        pi += cr[j] * (ai[r] + ai[R - r]);
+                        mr -= ci[j] * (ai[r] - ai[R - r]);
+                        mi += ci[j] * (ar[r] - ar[R - r]);
+                    }
+                    z[2 * S *      q ] = pr + mr; z[2 * S *      q  + 1] = pi + mi;
+                    z[2 * S * (R - q)] = pr - mr; z[2 * S * (R - q) + 1] = pi - mi;
+                }
             }
-            w = w + w * k;
+        }
+}
+
+// Apply Bluestein's algorithm using the tables w and scratch space t[0..2L].
+// The inverse conjugates its input and output, leaving the scaling to mixfft.
+
+static void bluestein(int s, int n, const float complex *w, float complex *v,
+                                                            float complex *t)
+{
+    const int L = bluelen(n);
+
+    const float *c = (const float *) (w);
+    const float *b = (const float *) (w + n);
+    float       *a = (float       *) (t);
+    float       *x = (float       *) (v);
+
+    for (int j = 0; j < n; j++)
+    {
+        const float xr = x[2 * j], xi = s * x[2 * j + 1];
+
+        a[2 * j    ] = xr * c[2 * j] - xi * c[2 * j + 1];
+        a[2 * j + 1] = xr * c[2 * j + 1] + xi * c[2 * j];
+    }
+    memset(a + 2 * n, 0, 2 * (L - n) * sizeof (float));
+
+    stockham(+1, L, w + n + L, t, t + L);
+
+    for (int j = 0; j < L; j++)
+    {
+        const float ar = a[2 * j], ai = a[2 * j + 1];
+
+        a[2 * j    ] = ar * b[2 * j] - ai * b[2 * j + 1];
+        a[2 * j + 1] = ar * b[2 * j + 1] + ai * b[2 * j];
+    }
+
+    stockham(-1, L, w + n + L, t, t + L);
+
+    for (int j = 0; j < n; j++)
+    {
+        const float ar = a[2 * j], ai = a[2 * j + 1];
+
+        x[2 * j    ] =      ar * c[2 * j] - ai * c[2 * j + 1];
+        x[2 * j + 1] = s * (ar * c[2 * j + 1] + ai * c[2 * j]);
+    }
+}
+
+// Apply the Fast Fourier Transform of any length n in place in v[0..n] using
+// the tables w given by mixalloc(n) and scratch space t[0..mixsize(n)]. Input
+// and output are in natural order. If s is -1 then apply the inverse.
+
+void mixfft(int s, int n, const float complex *w, float complex *v,
+                                                  float complex *t)
+{
+    int f[32], k;
+
+    float *x = (float *) v;
+
+    if (factor(n, f, &k))
+    {
+        const float *u = (const float *) w;
+
+        float *y = (float *) t;
+        float *z;
+
+        for (int i = 0, S = 1; i < k; S *= f[i], i++)
+        {
+            mpass(s, n, f[i], S, u, x, y);
+
+            u += 2 * (f[i] - 1) * S;
+            z  = x;
+            x  = y;
+            y  = z;
+        }
+
+        if (x != (float *) v)
+        {
+            memcpy(v, x, n * sizeof (float complex));
+            x = (float *) v;
         }
     }
+    else bluestein(s, n, w, v, t);
 
     if (s < 0)
-        for (int i = 0; i < n; ++i)
-            v[i] = v[i] / n;
+    {
+        const float k = 1.0f / n;
+
+        for (int i = 0; i < 2 * n; ++i)
+            x[i] = x[i] * k;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Apply whichever FFT suits length n and the tables w: the mixed-radix FFT if n
+// is not a power of two, else the Stockham FFT given scratch space t, else the
+// in-place FFT of bit-reversed input.
+
+void anyfft(int s, int n, const float complex *w, float complex *v,
+                                                  float complex *t)
+{
+    if      (!ispow2(n)) mixfft  (s, n, w, v, t);
+    else if (t)          stockham(s, n, w, v, t);
+    else                 fft     (s, n, w, v);
+}
+
+//------------------------------------------------------------------------------
+
+// Transform the two real sequences a[0..n] and b[0..n] at once using a single
+// complex FFT of a + ib. The forward transform reads the real parts of a and b
+// and separates the spectra using their Hermitian symmetry. The inverse
+// expects Hermitian spectra and gives real output. If t is given then the
+// input is in order and the Stockham or mixed-radix FFT applies, else it is
+// bit-reversed.
+
+void realfft(int s, int n, const float complex *w, float complex *t,
+                                 float complex *a, float complex *b)
+{
+    float *A = (float *) a;
+    float *B = (float *) b;
+
+    if (s > 0)
+    {
+        for (int k = 0; k < n; k++)
+            A[2 * k + 1] = B[2 * k];
+
+        anyfft(s, n, w, a, t);
+
+        // X[k] = (Z[k] + Z*[n - k]) / 2 and Y[k] = (Z[k] - Z*[n - k]) / 2i.
+
+        for (int k = 0; k <= n / 2; k++)
+        {
+            const int j = (n - k) % n;
+
+            const float zr = A[2 * k], zi = A[2 * k + 1];
+            const float yr = A[2 * j], yi = A[2 * j + 1];
+
+            const float xr = 0.5f * (zr + yr), xi = 0.5f * (zi - yi);
+            const float vr = 0.5f * (zi + yi), vi = 0.5f * (yr - zr);
+
+            A[2 * k] = xr; A[2 * k + 1] =  xi;
+            A[2 * j] = xr; A[2 * j + 1] = -xi;
+            B[2 * k] = vr; B[2 * k + 1] =  vi;
+            B[2 * j] = vr; B[2 * j + 1] = -vi;
+        }
+    }
+    else
+    {
+        for (int k = 0; k < n; k++)
+        {
+            A[2 * k    ] -= B[2 * k + 1];
+            A[2 * k + 1] += B[2 * k    ];
+        }
+
+        anyfft(s, n, w, a, t);
+
+        for (int k = 0; k < n; k++)
+        {
+            B[2 * k    ] = A[2 * k + 1];
+            B[2 * k + 1] = 0.0f;
+            A[2 * k + 1] = 0.0f;
+        }
+    }
 }
@@ -15,9 +15,24 @@
 
 //------------------------------------------------------------------------------
 
-int *revalloc(int n);
+int           *revalloc(int n);
+complex float *twialloc(int n);
 
-void fft(int s, int n, complex float *v);
+void fft     (int s, int n, const complex float *w, complex float *v);
+void stockham(int s, int n, const complex float *w, complex float *v,
+                                                    complex float *t);
+void batchfft(int s, int n, int b, const complex float *w, complex float *v,
+                                                           complex float *t);
+void realfft (int s, int n, const complex float *w, complex float *t,
+                                  complex float *a, complex float *b);
+
+complex float *mixalloc(int n);
+int            mixsize (int n);
+
+void mixfft  (int s, int n, const complex float *w, complex float *v,
+                                                    complex float *t);
+void anyfft  (int s, int n, const complex float *w, complex float *v,
+                                                    complex float *t);
 
 //------------------------------------------------------------------------------
 
@@ -21,191 +21,88 @@
 #include "img.h"
 #include "err.h"
 #include "etc.h"
-#include "fft.h"
+#include "win.h"
 
 //------------------------------------------------------------------------------
 
-static inline int range_rect(float r, float w, int m)
-{
-    return (int) ceil(r);
-}
-
-static inline int range_tri(float r, float w, int m)
-{
-    return (int) ceil(r + w / 2);
-}
-
-static inline int range_hann(float r, float w, int m)
-{
-    return (int) ceil(r + w / 2);
-}
-
-static inline int range_norm(float r, float w, int m)
-{
-    return m;
-}
-
-static inline int range_gauss(float r, float w, int m)
-{
-    return m;
-}
-
-static inline int range_butter(float r, float w, int m)
-{
-    return m;
-}
-
-static inline int range(int op, float r, float w, int m)
-{
-    switch (op)
-    {
-        case 'R': return range_rect  (r, w, m);
-        case 'T': return range_tri   (r, w, m);
-        case 'H': return range_hann  (r, w, m);
-        case 'g': return range_norm  (r, w, m);
-        case 'G': return range_gauss (r, w, m);
-        case 'B': return range_butter(r, w, m);
-    }
-    return (int) r;
-}
-
-//------------------------------------------------------------------------------
-
-static inline float filter_rect(float k, float r, float w)
-{
-    return (k > r) ? 0.f : 1.f;
-}
-
-static inline float filter_tri(float k, float r, float w)
-{
-    if (k > r + w / 2) return 0.f;
-    if (k < r - w / 2) return 1.f;
-    return 0.5f - k / w + r / w;
-}
-
-static inline float filter_hann(float k, float r, float w)
-{
-    return 0.5f - cosf(M_PI * filter_tri(k, r, w)) / 2.f;
-}
-
-static inline float filter_norm(float k, float r, float w)
-{
-    const float a =  1.f / (2.f * M_PI * r * r);
-    const float b = -1.f / (2.f        * r * r);
-    return a * expf(b * k * k);
-}
-
-static inline float filter_gauss(float k, float r, float w)
-{
-    return expf(-0.5f * (k * k) / (r * r));
-}
-
-static inline float filter_butter(float k, float r, float w)
-{
-    return 1.f / (1.f + powf(k / r, 2 * w));
-}
-
-static inline float filter(int op, float k, float r, float w)
-{
-    switch (op)
-    {
-        case 'R': return filter_rect  (k, r, w);
-        case 'T': return filter_tri   (k, r, w);
-        case 'H': return filter_hann  (k, r, w);
-        case 'g': return filter_norm  (k, r, w);
-        case 'G': return filter_gauss (k, r, w);
-        case 'B': return filter_butter(k, r, w);
-    }
-    return 1.f;
-}
-
-//------------------------------------------------------------------------------
-
-static inline float dist(int i, int j, int y, int x, float a)
-{
-    const float di = (i - y);
-    const float dj = (j - x);
-
-    return sqrtf(di * di + dj * dj * a * a);
-}
-
 // Apply the inverted filter. Assume anything outside the bounding box of the
 // window will remain one.
 
 static void inverse(img *d, int op, int x, int y, float r, float w)
 {
-    const int N = 1 << d->n;
-    const int M = 1 << d->m;
-    const int c =      d->p;
+    const int N = d->n;
+    const int M = d->m;
+    const int c = d->p;
 
     // Compute the size and aspect of the bounding box.
 
-    const int n = range(op, r, w, N);
-    int m;
-
-    if (op == 'g')
-        m = n;
-    else
-        m = (d->m > d->n) ? n << (d->m - d->n)
-                          : n >> (d->n - d->m);
+    struct win f;
 
-    const float a = (float) n / (float) m;
+    winset(&f, op, true, x, y, r, w, N, M);
 
     // Iterate over all pixels in the box, computing the filter value for each.
 
-    int   i;
-    int   j;
-    int   k;
-    float t;
+    size_t o;
+    int    i;
+    int    j;
+    int    k;
+    float  t;
 
-    #pragma omp parallel for private(j, k, t)
-    for     (i = max(0, y - n); i <= min(N - 1, y + n); i++)
-        for (j = max(0, x - m); j <= min(M - 1, x + m); j++)
+    const int x0 = max(0, x - f.m);
+    const int x1 = min(M - 1, x + f.m);
+
+    #pragma omp parallel for private(j, k, t, o)
+    for     (i = max(0, y - f.n); i <= min(N - 1, y + f.n); i++)
+    {
+        imgnext(d, i, x0, x1 - x0 + 1);
+
+        for (j = x0; j <= x1; j++)
         {
-            t = 1.f - filter(op, dist(i, j, y, x, a), r, w);
+            t = winval(&f, i, j);
+            o = imgzo(d, i, j);
 
             for (k = 0; k < c; k++)
-                imgz(d, i, j)[k] *= t;
+                imgset(d, imgco(d, o, k), imgval(d, imgco(d, o, k)) * t);
         }
+    }
 }
 
-// Apply the filter. Assume that anything outside the bounding box of the window
-// will be zeroed.
+// Apply the filter. Anything outside the bounding box of the window is zeroed.
 
 static void forward(img *d, int op, int x, int y, float r, float w)
 {
-    const int N = 1 << d->n;
-    const int M = 1 << d->m;
-    const int c =      d->p;
+    const int N = d->n;
+    const int M = d->m;
+    const int c = d->p;
 
     // Compute the size and aspect of the bounding box.
 
-    const int n = range(op, r, w, N);
-    int m;
+    struct win f;
 
-    if (op == 'g')
-        m = n;
-    else
-        m = (d->m > d->n) ? n << (d->m - d->n)
-                          : n >> (d->n - d->m);
+    winset(&f, op, false, x, y, r, w, N, M);
 
-    const float a = (float) n / (float) m;
+    // Iterate over all pixels, computing the filter value for each.
 
-    // Iterate over all pixels in the box, computing the filter value for each.
+    size_t o;
+    int    i;
+    int    j;
+    int    k;
+    float  t;
 
-    int i;
-    int j;
-    int k;
+    #pragma omp parallel for private(j, k, t, o)
+    for     (i = 0; i < N; i++)
+    {
+        imgnext(d, i, 0, M);
 
-    #pragma omp parallel for private(j, k)
-    for         (i = 0; i < N; i++)
-        for     (j = 0; j < M; j++)
-            for (k = 0; k < c; k++)
+        for (j = 0; j < M; j++)
+        {
+            t = winval(&f, i, j);
+            o = imgzo(d, i, j);
 
-                if (abs(i - y) > n || abs(j - x) > m)
-                    imgz(d, i, j)[k]  = 0.0f;
-                else
-                    imgz(d, i, j)[k] *= filter(op, dist(i, j, y, x, a), r, w);
+            for (k = 0; k < c; k++)
+                imgset(d, imgco(d, o, k), imgval(d, imgco(d, o, k)) * t);
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -218,11 +115,13 @@ static bool proc(const char *dst, int l, int n, int m, int p,
 
     if ((n && m && p) || imgargs(dst, &n, &m, &p))
     {
-        if (x == INT_MAX) x = 1 << (m - 1);
-        if (y == INT_MAX) y = 1 << (n - 1);
+        if (x == INT_MAX) x = m / 2;
+        if (y == INT_MAX) y = n / 2;
 
         if ((d = imgopen(dst, l, n, m, p)))
         {
+            imghint(d, IMG_SEQUENTIAL);
+
             if (i)
                 inverse(d, op, x, y, r, w);
             else
@@ -258,7 +157,7 @@ int main(int argc, char **argv)
     bool  t  = false;
     bool  i  = false;
     int   op = 0;
-    int   l  = 5;
+    int   l  = -1;
     int   n  = 0;
     int   m  = 0;
     int   p  = 0;
@@ -274,8 +173,8 @@ int main(int argc, char **argv)
         switch (o)
         {
             case 'l': l = strtol(optarg, 0, 0); break;
-            case 'n': n = strtol(optarg, 0, 0); break;
-            case 'm': m = strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = strtol(optarg, 0, 0); break;
             case 'x': x = strtol(optarg, 0, 0); break;
             case 'y': y = strtol(optarg, 0, 0); break;
@@ -11,200 +11,235 @@
 // more details.
 
 #include <getopt.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
 
+#include "dft.h"
 #include "img.h"
 #include "err.h"
 #include "etc.h"
-#include "fft.h"
+#include "win.h"
+#include "wis.h"
+#include "zip.h"
 
-enum options
-{
-    INVERSE   = 1,
-    TRANSPOSE = 2,
-};
+//------------------------------------------------------------------------------
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+static inline void omp_set_num_threads(int n) { }
+#endif
 
 //------------------------------------------------------------------------------
 
-static inline int offset(int x, int m, int s)
+static double now(void)
 {
-    if (s > 0)
-        return x;
-    else
-    {
-        const int n =  1 << (m - 1);
-        const int o = (1 << m) - 1;
+    struct timeval t;
 
-        return (x + n) & o;
-    }
+    gettimeofday(&t, 0);
+
+    return t.tv_sec + t.tv_usec / 1000000.0;
 }
 
-// Copy one row of tiles from the image to a raster. De-interleave the channels
-// and apply the offset and index bit reversal in preparation for FFT. Use a
-// tile-wise ordering for best input cache coherence.
+// Time a forward and inverse 2D transform of the named image with tile size l
+// and the given FFT variant. Return a negative time on failure.
 
-static void getrow(img *d, int r, int s, const int *v, float complex *z)
+static double trial(const char *name, int l, int n, int m, int p, int opt)
 {
-    for         (int c = 0; c < d->w; c++)
-        for     (int i = 0; i < d->s; i++)
-            for (int j = 0; j < d->s; j++)
-            {
-                const int x = v[offset((c << d->l) + j, d->m, +s)];
+    double t0 = now();
+    double t1 = -1.0;
 
-                imgget(d, r, c, i, j, z + (i << d->m) + x, d->s << d->m);
-            }
+    img *d;
+
+    if ((d = imgopen(name, l, n, m, p)))
+    {
+        if (dft(d, opt | TWOD, 0, NULL) && dft(d, opt | TWOD | INVERSE, 0, NULL))
+            t1 = now() - t0;
+
+        imgclose(d);
+    }
+    return t1;
 }
 
-// Copy one row of tiles from a raster to the image. Re-interleave the channels
-// and apply the offset following the FFT. Use a tile-wise ordering for best
-// output cache coherence.
+// Time a candidate plan with FFT variant s and report it.
 
-static void putrow(img *d, int r, int s, float complex *z)
+static double candidate(const char *name, int l, int n, int m, int p, int s)
 {
-    for         (int c = 0; c < d->w; c++)
-        for     (int i = 0; i < d->s; i++)
-            for (int j = 0; j < d->s; j++)
-            {
-                const int x = offset((c << d->l) + j, d->m, -s);
+    double t;
 
-                imgput(d, r, c, i, j, z + (i << d->m) + x, d->s << d->m);
-            }
+    if ((t = trial(name, l, n, m, p, dftvariant(s))) >= 0.0)
+        printf("l=%d sort=%d threads=%d time=%.3fs\n", l, s,
+                                                omp_get_max_threads(), t);
+    return t;
 }
 
-// Transpose one column of tiles from the image to a raster. De-interleave the
-// channels and apply the offset and index bit reversal in preparation for FFT.
-// Use a tile-wise ordering for best input cache coherence.
+// Create the scratch image with tile size l, as recorded in its header, and
+// fault it in once before timing anything.
 
-static void getcol(img *d, int c, int s, const int *v, float complex *z)
+static bool scratch(const char *name, int l, int n, int m, int p)
 {
-    for         (int r = 0; r < d->h; r++)
-        for     (int i = 0; i < d->s; i++)
-            for (int j = 0; j < d->s; j++)
-            {
-                const int y = v[offset((r << d->l) + i, d->n, +s)];
-
-                imgget(d, r, c, i, j, z + (j << d->n) + y, d->s << d->n);
-            }
+    return imginit(name, l, n, m, p, IMG_C32, ZIP_NONE, IMG_INTERLEAVED,
+                                                            NULL, 0)
+        && trial  (name, l, n, m, p, 0) >= 0.0;
 }
 
-// Transpose one column of tiles from a raster to the image. Re-interleave the
-// channels and apply the offset following the FFT. Use a tile-wise ordering for
-// best output cache coherence.
+// Plan the transform of an n by m image of p samples per pixel by creating a
+// scratch image of that size and timing each candidate tile size dividing the
+// image size, and each FFT variant, using all threads. Then time the winner
+// with fewer threads, as the memory system often saturates before the cores
+// do. Record the fastest in the wisdom file and remove the scratch image. The
+// scratch image must not already exist, lest a mistyped name destroy a cache.
 
-static void putcol(img *d, int c, int s, float complex *z)
+static bool plan(const char *name, int n, int m, int p)
 {
-    for         (int r = 0; r < d->h; r++)
-        for     (int i = 0; i < d->s; i++)
-            for (int j = 0; j < d->s; j++)
-            {
-                const int y = offset((r << d->l) + i, d->n, -s);
+    const int T  = omp_get_max_threads();
+    const int hi = min(8, log2i((n | m) & -(n | m)));
+    const int lo = min(3, hi);
+
+    double b = -1.0;
+    double t;
+    int    L = lo;
+    int    S = 0;
+    int    N = T;
+    bool  ok = true;
+    int    f;
+
+    if ((f = open(name, O_CREAT | O_EXCL | O_WRONLY, 0644)) == -1)
+    {
+        syserr("Failed to create scratch image %s", name);
+        return false;
+    }
+    close(f);
+
+    for     (int l = lo; ok && l <= hi; l++)
+        if ((ok = scratch(name, l, n, m, p)))
+            for (int s = 0;  s < DFT_VARIANTS; s++)
+                if ((t = candidate(name, l, n, m, p, s)) >= 0 && (b < 0 || t < b))
+                {
+                    b = t;
+                    L = l;
+                    S = s;
+                }
+
+    if (ok && (ok = scratch(name, L, n, m, p)))
+    {
+        for (int k = 1; k < T; k *= 2)
+        {
+            omp_set_num_threads(k);
 
-                imgput(d, r, c, i, j, z + (j << d->n) + y, d->s << d->n);
+            if ((t = candidate(name, L, n, m, p, S)) >= 0 && t < b)
+            {
+                b = t;
+                N = k;
             }
+        }
+        omp_set_num_threads(T);
+    }
+    remove(name);
+
+    return ok && b >= 0.0 && wisput(n, m, p, L, S, N);
 }
 
 //------------------------------------------------------------------------------
 
-// Transform a raster.
+// Parse a window argument, naming a window function as does filter, with an
+// optional I to invert it.
 
-static void transform(int n,  // raster rows
-                      int m,  // raster columns
-                      int p,  // pixel size
-                      int s,  // transformation sign
-           float complex *z)  // raster buffer
+static bool winarg(const char *arg, int *op, bool *inv)
 {
-    int r;
-    int k;
+    if (arg[0] && strchr("RTHgGB", arg[0]))
+    {
+        *op  = arg[0];
+        *inv = (arg[1] == 'I');
 
-    for     (k = 0; k < p; k++)
-        for (r = 0; r < n; r++)
-            fft(s, m, z + n * m * k + m * r);
+        return (arg[1] == 0 || (arg[1] == 'I' && arg[2] == 0));
+    }
+    return false;
 }
 
-// Orchestrate the Fourier transform of the ith row of tiles of image d. Gather
-// a set of tiles from the image, transform each line, and copy the results
-// back. This function forms the kernel of the OpenMP parallelization.
+// Window the spectrum as the final forward column-wise pass writes it, so that
+// filtering needs no sweep of its own. Column y of the image is the line here.
 
-static void dorow(img *d,
-                   int i,
-                   int opt,
-            const int *v,
-        float complex *z)
+static void window(void *data, int opt, int y, int k,
+                   float complex *z, int s, int n)
 {
-    const int n = d->s;
-    const int m = d->s * ((opt & TRANSPOSE) ? d->h : d->w);
-    const int p = d->p;
-
-    const int s = (opt & INVERSE) ? -1 : +1;
+    const struct win *f = (const struct win *) data;
 
-    if (opt & TRANSPOSE) getcol(d, i, s, v, z);
-    else                 getrow(d, i, s, v, z);
-
-    transform(n, m, p, s, z);
-
-    if (opt & TRANSPOSE) putcol(d, i, s, z);
-    else                 putrow(d, i, s, z);
+    if ((opt & TRANSPOSE) && !(opt & INVERSE))
+        for (int i = 0; i < n; i++)
+            z[i * s] *= winval(f, dftpos(i, n), y);
 }
 
 //------------------------------------------------------------------------------
 
-#ifdef _OPENMP
-#include <omp.h>
-#else
-static inline int omp_get_max_threads() { return 1; }
-static inline int omp_get_thread_num()  { return 0; }
-#endif
+// Confirm that the input conforms to spec and that the output can be created,
+// open the input and output images, and then do the job. Without an explicit
+// tile size, take the FFT variant and thread count from wisdom too, unless the
+// thread count is set in the environment. Given a window function, apply it
+// to the spectrum in the column-wise pass.
 
-static void fourier(img *d, int opt)
+static bool proc(const char *name, // image file name
+                         int l,    // log2 tile size
+                         int n,    // image height
+                         int m,    // image width
+                         int p,    // pixel size
+                         int opt,  // option flags
+                      size_t B,    // memory budget
+                         int op,   // window function
+                        bool inv,  // window inverted
+                         int x,    // window center column
+                         int y,    // window center row
+                       float r,    // window radius
+                       float w)    // window width
 {
-    int w = (opt & TRANSPOSE) ? d->h : d->w;
-    int h = (opt & TRANSPOSE) ? d->w : d->h;
-
-    int *v;
+    bool ok = false;
 
-    if ((v = revalloc(w * d->s)))
-    {
-        size_t N = omp_get_max_threads();
-        size_t M = d->p * d->s * d->s * w;
+    img *d;
 
-        float complex *z;
+    if ((opt & TWOD) && (opt & TRANSPOSE))
+        apperr("2D transform includes the transposed pass");
 
-        if ((z = (float complex *) calloc(N * M, sizeof (float complex))))
-        {
-            int i;
+    else if ((opt & REAL) && (opt & TRANSPOSE))
+        apperr("Real transform applies to rows only");
 
-            #pragma omp parallel for schedule(static, max(1, h / N))
-            for (i = 0; i < h; i++)
-                dorow(d, i, opt, v, z + M * omp_get_thread_num());
+    else if (op && ((opt & INVERSE) || !(opt & (TWOD | TRANSPOSE))))
+        apperr("Window applies to a forward column-wise transform");
 
-            free(z);
-        }
-        free(v);
+    else if (opt & PLAN)
+    {
+        if (n && m && p)
+            ok = plan(name, n, m, p);
+        else
+            apperr("Planning requires image height, width, and pixel size");
     }
-}
 
-// Confirm that the input conforms to spec and that the output can be created,
-// open the input and output images, and then do the job.
+    else if ((n && m && p) || imgargs(name, &n, &m, &p))
+    {
+        struct win f;
+        dfthook    h = { window, &f };
 
-static bool proc(const char *name, // image file name
-                         int l,    // log2 tile size
-                         int n,    // log2 image height
-                         int m,    // log2 image width
-                         int p,    // pixel size
-                         int opt)  // option flags
-{
-    bool ok = false;
+        if (x == INT_MAX) x = m / 2;
+        if (y == INT_MAX) y = n / 2;
 
-    img *d;
+        winset(&f, op, inv, x, y, r, w, n, m);
 
-    if ((n && m && p) || imgargs(name, &n, &m, &p))
-    {
-        if ((d = imgopen(name, l, n, m, p)))
+        opt |= dftwisdom(l, n, m, p);
+
+        // A real image is widened to hold its spectrum, and the real output
+        // of a real inverse transform is narrowed back.
+
+        if ((imgformat(name) != IMG_R32 || imgconvert(name, l, n, m, p, IMG_C32))
+                                      && (d = imgopen(name, l, n, m, p)))
         {
-            fourier(d, opt);
-            ok = true;
+            ok = dft(d, opt, B, op ? &h : NULL);
             imgclose(d);
+
+            if (ok && (opt & REAL) && (opt & INVERSE) && imgformat(name) == IMG_C32)
+                ok = imgconvert(name, l, n, m, p, IMG_R32);
         }
     }
     else apperr("Failed to guess '%s' image parameters", name);
@@ -216,7 +251,13 @@ static bool proc(const char *name, // image file name
 
 static int usage(const char *exe)
 {
-    fprintf(stderr, "Usage:\t%s [-tIT] "
+    fprintf(stderr, "Usage:\t%s [-tITSVR2P] "
+                               "[-B budget] "
+                               "[-F window] "
+                               "[-x X] "
+                               "[-y Y] "
+                               "[-r radius] "
+                               "[-w width] "
                                "[-l size] "
                                "[-n height] "
                                "[-m width] "
@@ -229,24 +270,51 @@ int main(int argc, char **argv)
     bool  ok  = false;
     bool  t   = false;
     int   opt = 0;
-    int   l   = 5;
+    int   l   = -1;
     int   n   = 0;
     int   m   = 0;
     int   p   = 0;
+    int   op  = 0;
+    bool  inv = false;
+    int   x   = INT_MAX;
+    int   y   = INT_MAX;
+    float r   = 0.f;
+    float w   = 0.f;
     int   o;
 
+    size_t B  = 0;
+
     // Parse the command line options.
 
-    while ((o = getopt(argc, argv, "N:TIl:n:m:p:t")) != -1)
+    while ((o = getopt(argc, argv, "N:TISVR2PB:F:x:y:r:w:l:n:m:p:t")) != -1)
         switch (o)
         {
             case 'l': l = (int) strtol(optarg, 0, 0); break;
-            case 'n': n = (int) strtol(optarg, 0, 0); break;
-            case 'm': m = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = (int) strtol(optarg, 0, 0); break;
+            case 'x': x = (int) strtol(optarg, 0, 0); break;
+            case 'y': y = (int) strtol(optarg, 0, 0); break;
+            case 'r': r =       strtof(optarg, 0);    break;
+            case 'w': w =       strtof(optarg, 0);    break;
+
+            case 'F':
+                if (!winarg(optarg, &op, &inv))
+                    return usage(argv[0]);
+                break;
+
+            case 'B':
+                if ((B = strtosize(optarg)) == 0)
+                    return usage(argv[0]);
+                break;
 
             case 'I': opt |= INVERSE;   break;
             case 'T': opt |= TRANSPOSE; break;
+            case 'S': opt |= AUTOSORT;  break;
+            case 'V': opt |= BATCH;     break;
+            case 'R': opt |= REAL;      break;
+            case '2': opt |= TWOD;      break;
+            case 'P': opt |= PLAN;      break;
 
             case 't': t = true; break;
             case '?':
@@ -264,7 +332,7 @@ int main(int argc, char **argv)
     {
         if (optind + 1 == argc)
         {
-            ok = proc(argv[optind], l, n, m, p, opt);
+            ok = proc(argv[optind], l, n, m, p, opt, B, op, inv, x, y, r, w);
         }
         else return usage(argv[0]);
     }
@@ -67,10 +67,10 @@ def imgp(img):
     return img[4]
 
 def imgh(img):
-    return 1 << imgn(img)
+    return imgn(img) if imgn(img) >= 32 else 1 << imgn(img)
 
 def imgw(img):
-    return 1 << imgm(img)
+    return imgm(img) if imgm(img) >= 32 else 1 << imgm(img)
 
 def imgargs(img):
     return '-l{} -n{} -m{} -p{}'.format(imgl(img), imgn(img), imgm(img), imgp(img))
@@ -114,6 +114,18 @@ def toimge(tif):
                int(dat.group(4)),
                int(dat.group(5)))
 
+# Convert the given real tif to an image cache of real samples, at half the size.
+
+def toimgr(tif):
+    tmp = mktemp()
+    out = run('convert{} -v -f r32 -l5 {} {}'.format(timing, tif, tmp))
+    dat = re.search('(\S+) (\d+) (\d+) (\d+) (\d+)', out)
+    return imgmake(dat.group(1),
+               int(dat.group(2)),
+               int(dat.group(3)),
+               int(dat.group(4)),
+               int(dat.group(5)))
+
 # Convert the given image cache to a tif with the given name.
 
 def totif(img, tif):
@@ -211,14 +223,23 @@ def kernel_circle(dst, r):
 # Perform a 2D Fourier analysis of the source image.
 
 def fourier2d(dst):
-    run('fourier{} {}     {}'.format(timing, imgargs(dst), imgname(dst)))
-    run('fourier{} {} -T  {}'.format(timing, imgargs(dst), imgname(dst)))
+    run('fourier{} {} -2   {}'.format(timing, imgargs(dst), imgname(dst)))
 
 # Perform a 2D Fourier synthesis of the source image.
 
 def inverse2d(dst):
-    run('fourier{} {} -I  {}'.format(timing, imgargs(dst), imgname(dst)))
-    run('fourier{} {} -IT {}'.format(timing, imgargs(dst), imgname(dst)))
+    run('fourier{} {} -I2  {}'.format(timing, imgargs(dst), imgname(dst)))
+
+# Perform a 2D Fourier analysis of a real source image, two rows per FFT.
+
+def fourier2dr(dst):
+    run('fourier{} {} -2R  {}'.format(timing, imgargs(dst), imgname(dst)))
+
+# Perform a 2D Fourier synthesis of a real image. The inverse orders its passes
+# column-wise first, so the real row-wise pass comes last.
+
+def inverse2dr(dst):
+    run('fourier{} {} -I2R {}'.format(timing, imgargs(dst), imgname(dst)))
 
 #-------------------------------------------------------------------------------
 
@@ -238,61 +259,33 @@ def transfer(dst, src, W, H):
 
 #-------------------------------------------------------------------------------
 
-# Perform frequency-domain morphology using convolution and thresholding.
+# Convolve a real image with a normalized kernel of the given type and radius,
+# in a single process, and select the results at or above the given level.
 
-def dilate(dst, r):
-    l   = imgl(dst)
-    n   = imgn(dst)
-    m   = imgm(dst)
-    p   = imgp(dst)
-    ker = reserve(l, n, m, p)
+def convolve(dst, k, r, s=None):
+    sel = '' if s is None else ' -s{}'.format(s)
+    run('convolve{} {} -R -{} -r{}{} {}'.format(timing, imgargs(dst),
+                                                k, r, sel, imgname(dst)))
+
+#-------------------------------------------------------------------------------
 
-    kernel_circle(ker, r)
-    fourier2d(ker)
-    fourier2d(dst)
-    mul(dst, ker)
-    inverse2d(dst)
-    select_gte(dst, 0.001)
+# Perform frequency-domain morphology using convolution and thresholding. With a
+# unit-gain kernel, the convolution of the inverted image is the inversion of
+# the convolution, so erosion needs no inversion of its own.
 
-    imgrm(ker)
+def dilate(dst, r):
+    convolve(dst, 'c', r, 0.001)
 
 def erode(dst, r):
-    l   = imgl(dst)
-    n   = imgn(dst)
-    m   = imgm(dst)
-    p   = imgp(dst)
-    ker = reserve(l, n, m, p)
-
-    kernel_circle(ker, r)
-    invert(dst)
-    fourier2d(ker)
-    fourier2d(dst)
-    mul(dst, ker)
-    inverse2d(dst)
-    invert(dst)
-    select_gte(dst, 0.999)
-
-    imgrm(ker)
+    convolve(dst, 'c', r, 0.999)
 
 #-------------------------------------------------------------------------------
 
-# Perform a frequency-domain Gaussian blur using convolution.
+# Perform a frequency-domain Gaussian blur using convolution. A spectral window
+# of radius n / pi / r is a spatial Gaussian of radius r / 2.
 
 def blur(dst, r):
-    l   = imgl(dst)
-    n   = imgn(dst)
-    m   = imgm(dst)
-    p   = imgp(dst)
-    ker = reserve(l, n, m, p)
-
-    filter_gaussian(ker, (1 << m) / 2,
-                         (1 << n) / 2,
-                         (1 << n) / math.pi / r)
-    fourier2d(dst)
-    mul(dst, ker)
-    inverse2d(dst)
-
-    imgrm(ker)
+    convolve(dst, 'g', r / 2.0)
 
 #-------------------------------------------------------------------------------
 
@@ -73,21 +73,21 @@ static float *readmap(const char *tif, int *w, int *p)
 // Map one pixel of the source onto one pixel of the destination by linearly
 // interpolation of the given gradient. Clamp values outside (g0, g1).
 
-static inline void pixel(float complex *d,
-                   const float complex *s,
-                   const float         *g, int w, int q, float g0, float g1)
+static inline void pixel(img *d, size_t o,
+                         img *s, size_t O,
+                   const float *g, int w, int q, float g0, float g1)
 {
-    const float t = (creal(s[0]) - g0) / (g1 - g0);
+    const float t = (creal(imgval(s, O)) - g0) / (g1 - g0);
 
     if      (t <= 0.0)
     {
         for (int k = 0; k < q; k++)
-            d[k] = g[k];
+            imgset(d, imgco(d, o, k), g[k]);
     }
     else if (t >= 1.0)
     {
         for (int k = 0; k < q; k++)
-            d[k] = g[w * q - q + k];
+            imgset(d, imgco(d, o, k), g[w * q - q + k]);
     }
     else
     {
@@ -96,8 +96,8 @@ static inline void pixel(float complex *d,
         const int   i1 = (int) floorf(i) + 1;
 
         for (int k = 0; k < q; k++)
-            d[k] = g[i0 * q + k] * (i1 - i)
-                 + g[i1 * q + k] * (i - i0);
+            imgset(d, imgco(d, o, k), g[i0 * q + k] * (i1 - i)
+                                    + g[i1 * q + k] * (i - i0));
     }
 }
 
@@ -115,12 +115,17 @@ static void map(img *d, img *s,
 
     #pragma omp parallel for private(c, i, j)
     for             (r = 0; r < d->h; r++)
+    {
+        imgfetch(d, r + 1, 0, 1, d->w);
+        imgfetch(s, r + 1, 0, 1, s->w);
+
         for         (c = 0; c < d->w; c++)
             for     (i = 0; i < d->s; i++)
                 for (j = 0; j < d->s; j++)
 
-                    pixel(imgbuf(d, r, c, i, j),
-                          imgbuf(s, r, c, i, j), g, w, q, g0, g1);
+                    pixel(d, imgbo(d, r, c, i, j),
+                          s, imgbo(s, r, c, i, j), g, w, q, g0, g1);
+    }
 }
 
 // Load the gradient image and initialize the source and destination.
@@ -145,6 +150,9 @@ static bool proc(const char *dst,
             {
                 if ((d = imgopen(dst, l, n, m, q)))
                 {
+                    imgkeep(s);
+                    imghint(s, IMG_SEQUENTIAL);
+                    imghint(d, IMG_SEQUENTIAL);
                     map(d, s, g, w, q, g0, g1);
                     imgclose(d);
                 }
@@ -179,7 +187,7 @@ int main(int argc, char **argv)
 
     bool ok  = false;
     bool t   = false;
-    int  l   = 5;
+    int  l   = -1;
     int  n   = 0;
     int  m   = 0;
     int  p   = 0;
@@ -194,8 +202,8 @@ int main(int argc, char **argv)
         switch (o)
         {
             case 'l': l  =   (int) strtol(optarg, 0, 0); break;
-            case 'n': n  =   (int) strtol(optarg, 0, 0); break;
-            case 'm': m  =   (int) strtol(optarg, 0, 0); break;
+            case 'n': n  =   imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m  =   imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p  =   (int) strtol(optarg, 0, 0); break;
             case '0': g0 = (float) strtod(optarg, 0);    break;
             case '1': g1 = (float) strtod(optarg, 0);    break;
@@ -10,29 +10,424 @@
 // FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
 // more details.
 
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <float.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sched.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 
 #include "err.h"
 #include "etc.h"
 #include "img.h"
+#include "aio.h"
+#include "pool.h"
+#include "stripe.h"
+#include "wis.h"
+#include "zip.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+static inline int omp_get_thread_num()  { return 0; }
+#endif
+
+//------------------------------------------------------------------------------
+
+// An image cache begins with a header giving its parameters and the domain of
+// its samples, padded to one page. An index of the statistics of each tile
+// follows, padded so that the samples remain page aligned, or huge page aligned
+// on hugetlbfs. The index is marked stale while the cache is open, and marked
+// current as it is closed only if the tool has tallied every tile, or has not
+// changed the image. A version 1 header, as given only to narrow caches, has
+// no index and no domain. A cache without a header is a bare array of complex
+// float samples. A version 3 header marks a compressed cache, in which a table
+// of blocks follows the index, and the blocks follow the table. A version 4
+// header marks a cache with planar tiles, compressed or not. A version 5 header
+// marks a striped cache, whose file holds only its header and index, with the
+// paths of the files holding its samples listed in the header page.
+
+#define HEADER  4096
+#define STRIPES 1024
+
+struct header
+{
+    char magic[4];  // "GIGO"
+    int  v;         // version
+    int  k;         // sample format
+    int  l;         // log2 tile size
+    int  n;         // height
+    int  m;         // width
+    int  p;         // pixel size
+    int  o;         // data offset, or zero for HEADER
+    int  e;         // domain
+    int  x;         // index is current
+    int  z;         // compression codec
+    int  b;         // compressed frame size
+    int  y;         // tile layout
+    int  d;         // stripe count
+};
+
+struct imgidx
+{
+    struct header   h;  // header, as it will be written back
+    struct imgstat *v;  // statistics of each channel of each tile
+    int             w;  // tile array width
+    size_t          n;  // tile count
+    size_t          c;  // tiles tallied
+    bool            f;  // index has space in the file
+    bool            x;  // index was current when opened
+    bool            k;  // image is unchanged
+};
+
+// Read the header of the named image cache, if it has one.
+
+static bool imghead(const char *name, struct header *h)
+{
+    bool ok = false;
+    int  f;
+
+    memset(h, 0, sizeof (struct header));
+
+    if ((f = open(name, O_RDONLY)) != -1)
+    {
+        ok = (pread(f, h, sizeof (struct header), 0) == sizeof (struct header)
+                && memcmp(h->magic, "GIGO", 4) == 0 && 1 <= h->v
+                                                         && h->v <= 5);
+        close(f);
+    }
+    return ok;
+}
+
+// Give the size of the index of an image with the given parameters.
+
+static size_t imgidxsize(int l, int n, int m, int p)
+{
+    return (size_t) (n >> l) * (m >> l) * p * sizeof (struct imgstat);
+}
+
+//------------------------------------------------------------------------------
+
+// Huge pages are used where the environment variable GIGO_HUGE asks for them.
+// "thp" advises transparent huge pages for scratch buffers and cache mappings,
+// and "hugetlb" takes scratch buffers from the reserved huge page pool, falling
+// back upon transparent huge pages if the pool is exhausted. A cache placed on
+// hugetlbfs is mapped with huge pages regardless.
+
+#define HUGE_THP     1
+#define HUGE_HUGETLB 2
+#define HUGE_SIZE    (2 << 20)
+
+static int imghugemode(void)
+{
+    static int mode = -1;
+
+    if (mode < 0)
+    {
+        const char *e = getenv("GIGO_HUGE");
+
+        mode = 0;
+
+        if (e)
+        {
+            if      (strcmp(e, "thp")     == 0) mode = HUGE_THP;
+            else if (strcmp(e, "hugetlb") == 0) mode = HUGE_HUGETLB;
+            else apperr("GIGO_HUGE %s is not recognized", e);
+        }
+    }
+    return mode;
+}
+
+// Give the huge page size of the file system holding the named file, or zero
+// if it is not hugetlbfs.
+
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
+
+static size_t imghuge(const char *name)
+{
+    struct statfs buf;
+
+    if (statfs(name, &buf) == 0 && buf.f_type == HUGETLBFS_MAGIC)
+        return (size_t) buf.f_bsize;
+
+    return 0;
+}
+
+// Allocate n bytes of zeroed scratch memory, backed by huge pages if so asked
+// and if large enough to benefit. Free it given the same size.
+
+void *imgalloc(size_t n)
+{
+    const int    h = imghugemode();
+    const size_t N = (n + HUGE_SIZE - 1) / HUGE_SIZE * HUGE_SIZE;
+
+    void *a = MAP_FAILED;
+
+    if (h == 0 || n < HUGE_SIZE)
+        return calloc(n, 1);
+
+    if (h == HUGE_HUGETLB)
+        a = mmap(0, N, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (a == MAP_FAILED)
+    {
+        if ((a = mmap(0, N, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+            return NULL;
+
+        madvise(a, N, MADV_HUGEPAGE);
+    }
+    return a;
+}
+
+void imgfree(void *a, size_t n)
+{
+    if (imghugemode() == 0 || n < HUGE_SIZE)
+        free(a);
+    else if (a)
+        munmap(a, (n + HUGE_SIZE - 1) / HUGE_SIZE * HUGE_SIZE);
+}
+
+//------------------------------------------------------------------------------
+
+// NUMA placement follows the environment variable GIGO_NUMA. "bind" pins the
+// threads of each team to the CPUs allowed the process, spread evenly among
+// them, so that each thread stays on one node with the rows of tiles a static
+// schedule gives it, and with the pages of them it first touches. "interleave"
+// pins them likewise, and interleaves the pages each thread faults in, of cache
+// mappings and pools alike, among the allowed nodes, which suits passes in
+// which every thread touches every row. Scratch is always local to its owner.
+
+#define NUMA_BIND       1
+#define NUMA_INTERLEAVE 2
+#define NUMA_NODES      1024
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED      1
+#define MPOL_INTERLEAVE     3
+#define MPOL_F_MEMS_ALLOWED 4
+#endif
+
+static int imgnumamode(void)
+{
+    static int mode = -1;
+
+    if (mode < 0)
+    {
+        const char *e = getenv("GIGO_NUMA");
+
+        mode = 0;
+
+        if (e)
+        {
+            if      (strcmp(e, "off")        == 0) mode = 0;
+            else if (strcmp(e, "bind")       == 0) mode = NUMA_BIND;
+            else if (strcmp(e, "interleave") == 0) mode = NUMA_INTERLEAVE;
+            else apperr("GIGO_NUMA %s is not recognized", e);
+        }
+    }
+    return mode;
+}
+
+// Pin thread i of each new team of T threads to the (i C / T)th of the C CPUs
+// allowed the process when first asked, and give it the interleaving policy if
+// so asked. A team of a size already pinned is left as it is.
+
+static void imgpin(void)
+{
+    static unsigned long m[NUMA_NODES / (8 * sizeof (unsigned long))];
+    static cpu_set_t     all;
+    static bool          V = false;
+    static int           C = -1;
+    static int           P =  0;
+
+    const int h = imgnumamode();
+    const int T = omp_get_max_threads();
+
+    if (h == 0 || P == T)
+        return;
+
+    if (C < 0)
+    {
+        C = sched_getaffinity(0, sizeof (all), &all) ? 0 : CPU_COUNT(&all);
+        V = h == NUMA_INTERLEAVE && syscall(SYS_get_mempolicy, NULL, m,
+                                NUMA_NODES, NULL, MPOL_F_MEMS_ALLOWED) == 0;
+    }
+
+    #pragma omp parallel num_threads(T)
+    {
+        const int i = (int) ((long) omp_get_thread_num() * C / T);
+
+        cpu_set_t s;
+        int       c;
+        int       j;
+
+        for (c = 0, j = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &all) && j++ == i)
+                break;
+
+        if (c < CPU_SETSIZE)
+        {
+            CPU_ZERO(&s);
+            CPU_SET (c, &s);
+            sched_setaffinity(0, sizeof (s), &s);
+        }
+        if (V)
+            syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, m, NUMA_NODES);
+    }
+    P = T;
+}
+
+// Place the n bytes of scratch a on the node of the calling thread, whatever its
+// policy, by touching them there.
+
+static void *imglocal(void *a, size_t n)
+{
+    const size_t P = (size_t) sysconf(_SC_PAGESIZE);
+
+    if (a)
+    {
+        const size_t b = ((size_t) a + P - 1) / P * P;
+        const size_t e = ((size_t) a + n) / P * P;
+
+        if (imgnumamode() == NUMA_INTERLEAVE && b < e)
+            syscall(SYS_mbind, (void *) b, e - b, MPOL_PREFERRED, NULL, 0, 0);
+
+        memset(a, 0, n);
+    }
+    return a;
+}
+
+// Allocate n bytes of zeroed scratch memory for each thread of a team, each by
+// the thread that owns it and so on its node, and pin the team as asked. Free
+// them given the same size.
+
+void **imgallocs(size_t n)
+{
+    const int T = omp_get_max_threads();
+
+    void **a;
+    int    c = 0;
+
+    imgpin();
+
+    if ((a = (void **) calloc(T + 1, sizeof (void *))))
+    {
+        #pragma omp parallel num_threads(T) reduction(+:c)
+        if ((a[omp_get_thread_num()] = imglocal(imgalloc(n), n)))
+            c++;
+
+        if (c == T)
+            return a;
+
+        for (int i = 0; i < T; i++)
+            imgfree(a[i], n);
+
+        free(a);
+    }
+    return NULL;
+}
+
+void imgfrees(void **a, size_t n)
+{
+    if (a)
+    {
+        for (int i = 0; a[i]; i++)
+            imgfree(a[i], n);
+
+        free(a);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Parse the name of a sample format.
+
+int imgfmt(const char *name)
+{
+    if (strcmp(name, "c32")  == 0) return IMG_C32;
+    if (strcmp(name, "f16")  == 0) return IMG_F16;
+    if (strcmp(name, "bf16") == 0) return IMG_B16;
+    if (strcmp(name, "r32")  == 0) return IMG_R32;
+
+    apperr("Unknown sample format %s", name);
+    return -1;
+}
+
+// Convert n samples between complex float and format k. Real samples drop the
+// imaginary part and gain a zero one.
+
+static void imgpack(int k, void *dst, const float complex *src, size_t n)
+{
+    switch (k)
+    {
+        case IMG_F16: vecftoh(dst, (const float *) src, 2 * n); break;
+        case IMG_B16: vecftob(dst, (const float *) src, 2 * n); break;
+        case IMG_R32:
+            for (size_t i = 0; i < n; i++)
+                ((float *) dst)[i] = crealf(src[i]);
+            break;
+        default:      memcpy (dst, src, sizeof (float complex) * n);
+    }
+}
+
+static void imgunpack(int k, float complex *dst, const void *src, size_t n)
+{
+    switch (k)
+    {
+        case IMG_F16: vechtof((float *) dst, src, 2 * n); break;
+        case IMG_B16: vecbtof((float *) dst, src, 2 * n); break;
+        case IMG_R32:
+            for (size_t i = 0; i < n; i++)
+                dst[i] = ((const float *) src)[i];
+            break;
+        default:      memcpy (dst, src, sizeof (float complex) * n);
+    }
+}
+
+// Give the size of each float of a sample of format k, by which the bytes of a
+// compressed frame are shuffled.
+
+static size_t imgword(int k)
+{
+    return (k == IMG_C32 || k == IMG_R32) ? sizeof (float) : sizeof (float) / 2;
+}
 
 //------------------------------------------------------------------------------
 
-// Use the size of the named image cache file to guess at its parameters. Use
-// the assumption that the pixel size is 1 or 3, and that the image has power of
-// two size and either a 2:1 or 1:1 aspect ratio. Tile size cannot be guessed.
+// Use the header of the named image cache file to give its parameters, or its
+// size to guess at them. Use the assumption that the pixel size is 1 or 3, and
+// that the image has power of two size and either a 2:1 or 1:1 aspect ratio.
+// Tile size cannot be guessed, nor can any size that is not a power of two.
 
 bool imgargs(const char *name,  // file name
-                    int *n,     // log2 height
-                    int *m,     // log2 width
+                    int *n,     // height
+                    int *m,     // width
                     int *p)     // pixel size
 {
+    struct header h;
     struct stat buf;
 
+    if (imghead(name, &h))
+    {
+        *n = h.n;
+        *m = h.m;
+        *p = h.p;
+        return true;
+    }
     if (stat(name, &buf) != -1)
     {
         size_t whp = buf.st_size / sizeof (float complex);
@@ -45,13 +440,13 @@ bool imgargs(const char *name,  // file name
 
             if (nm % 2)
             {
-                *n = (nm - 1) / 2;
-                *m = (nm + 1) / 2;
+                *n = 1 << (nm - 1) / 2;
+                *m = 1 << (nm + 1) / 2;
             }
             else
             {
-                *n = nm / 2;
-                *m = nm / 2;
+                *n = 1 << nm / 2;
+                *m = 1 << nm / 2;
             }
             return true;
         }
@@ -62,112 +457,1409 @@ bool imgargs(const char *name,  // file name
     return false;
 }
 
-// Clear space for an image cache file.
+// Transfer len bytes between buffer and file at offset o, resuming after any
+// short read or write.
 
-bool imginit(const char *name,  // file name
-                    int  l,     // log2 tile size
-                    int  n,     // log2 height
-                    int  m,     // log2 width
-                    int  p,     // pixel size
-           float complex v)     // value
+static bool imgxfer(int f, char *buf, size_t len, off_t o, bool out)
 {
-    // Allocate and initialize a temporary buffer of complex values.
+    while (len > 0)
+    {
+        ssize_t k = out ? pwrite(f, buf, len, o)
+                        : pread (f, buf, len, o);
+        if (k > 0)
+        {
+            buf += k;
+            len -= k;
+            o   += k;
+        }
+        else return false;
+    }
+    return true;
+}
 
-    const size_t N = 1024;
-    float complex a[N];
+// Transfer len bytes between buffer and image file at offset o. As hugetlbfs
+// supports no pwrite, a cache there is copied through its mapping.
+
+static bool imgio(img *d, void *buf, size_t len, off_t o, bool out)
+{
+    if (d->u)
+    {
+        char *a = (char *) d->a - d->o + o;
+
+        memcpy(out ? a : buf, out ? buf : a, len);
+        return true;
+    }
+    return imgxfer(d->f, (char *) buf, len, o, out);
+}
+
+// Write n bytes at offset o of image file f, repeating the N bytes of b to fill
+// them. Given the mapping a of the file, copy them in instead, as hugetlbfs
+// supports no write.
+
+static bool imgrep(int f, char *a, off_t o, const void *b, size_t N, size_t n)
+{
+    while (n > 0)
+    {
+        const size_t c = min(n, N);
+
+        if (a)
+            memcpy(a + o, b, c);
+        else if (!imgxfer(f, (char *) b, c, o, true))
+            return false;
+
+        o += c;
+        n -= c;
+    }
+    return true;
+}
+
+// Fill n bytes at offset o of image file f, or of its mapping a, with the value
+// given by the N bytes of b, in large blocks written in parallel. Each block is
+// a whole number of samples, so one buffer of repeated samples serves them all.
+
+#define FILL (4 << 20)
+
+static bool imgfill(int f, char *a, off_t o, const void *b, size_t N, size_t n)
+{
+    const size_t S = (FILL / N) * N;
+    const long   J = (long) ((n + S - 1) / S);
+
+    long  e = 0;
+    long  j;
+    char *B;
+
+    if ((B = (char *) malloc(S)) == NULL)
+        return false;
+
+    for (size_t i = 0; i < S; i += N)
+        memcpy(B + i, b, N);
+
+    #pragma omp parallel for reduction(+:e)
+    for (j = 0; j < J; j++)
+    {
+        const off_t  p = o + (off_t) S * j;
+        const size_t r = n - S * (size_t) j;
+        const size_t c = (r < S) ? r : S;
+
+        if (a)
+            memcpy(a + p, B, c);
+        else if (!imgxfer(f, B, c, p, true))
+            e++;
+    }
+
+    free(B);
+    return (e == 0);
+}
+
+// Determine whether the N bytes of b are all zero, as a file is when extended.
 
+static bool imgzero(const void *b, size_t N)
+{
     for (size_t i = 0; i < N; i++)
-        a[i] = v;
+        if (((const char *) b)[i])
+            return false;
+
+    return true;
+}
 
-    // Write a value for each sample of each pixel using this buffer.
+// The environment variable GIGO_ALLOC may ask that the samples of a new image
+// cache be allocated on disk up front, rather than left sparse, so that they
+// do not fragment as they are written piecemeal later.
 
-    size_t M = sizeof (float complex) * p << (n + m);
-    size_t O = sizeof (float complex) * N;
-    int    fd;
+static bool imgprealloc(void)
+{
+    static int mode = -1;
 
-    if ((fd = open(name, O_CREAT | O_TRUNC | O_WRONLY, 0644)) != -1)
+    if (mode < 0)
     {
-        while (M > 0)
-        {
-            size_t o = min(M, O);
+        const char *e = getenv("GIGO_ALLOC");
 
-            if (write(fd, a, o) == (ssize_t) o)
-                M -= o;
-            else
-            {
-                syserr("Failed to write image %s", name);
-                break;
-            }
+        mode = 0;
+
+        if (e)
+        {
+            if      (strcmp(e, "sparse")    == 0) mode = 0;
+            else if (strcmp(e, "fallocate") == 0) mode = 1;
+            else apperr("GIGO_ALLOC %s is not recognized", e);
         }
-        close(fd);
     }
-    else syserr("Failed to open image %s", name);
+    return mode;
+}
+
+// Give the size of the frames of a compressed image, which is the tile size
+// rounded up to whole pages, as the buffer pool pages whole frames.
 
-    return (M == 0);
+static size_t imgframe(int k, int l, int p)
+{
+    const size_t P = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t t = imgsize(k) * (p << (l + l));
+
+    return t ? (t + P - 1) / P * P : P;
 }
 
-// Open an image cache file and return a new img structure.
+// Write the block table of a new compressed image at offset o, with all of its
+// frames sharing one block at offset d, filled with the repeated N bytes of b.
 
-img *imgopen(const char *name,  // file name
-                    int  l,     // log2 tile size
-                    int  n,     // log2 height
-                    int  m,     // log2 width
-                    int  p)     // pixel size
+static bool imgzip(int f, off_t o, int k, size_t F, size_t M, off_t d,
+                                          const void *b, size_t N)
 {
-    size_t len = (sizeof (float complex) * p) << (n + m);
-    struct stat buf;
+    bool  ok = false;
+    char *a;
 
-    int prot = PROT_READ | PROT_WRITE;
-    int    f;
-    img   *d;
-    void  *a;
+    if ((a = (char *) malloc(F)))
+    {
+        for (size_t i = 0; i < F; i += N)
+            memcpy(a + i, b, min(N, F - i));
+
+        ok = zipinit(f, o, (M + F - 1) / F, F, imgword(k), d, a);
+        free(a);
+    }
+    return ok;
+}
+
+// Give the size of each row of tiles, the unit dealt among the files of a
+// striped image, which must be whole pages for the files to be mapped.
+
+static size_t imgrowsize(int k, int l, int m, int p)
+{
+    return (imgsize(k) * p * m) << l;
+}
+
+// List the files of a striped image, one in each directory of the colon-
+// separated string dirs, named for the image and numbered. Resolve each
+// directory so that the list holds from anywhere. Give the number of files, or
+// -1 if the directories cannot be listed.
+
+static int imgpaths(const char *name, const char *dirs, char *list)
+{
+    const char *b = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
 
-    if (stat(name, &buf) != -1 && buf.st_size == len)
+    char   dir[PATH_MAX];
+    char   res[PATH_MAX];
+    size_t c = 0;
+    int    D = 0;
+
+    memset(list, 0, HEADER - STRIPES);
+
+    while (*dirs)
     {
-        if ((d = (img *) malloc(sizeof (img))))
+        const size_t k = strcspn(dirs, ":");
+        int          w;
+
+        if (k >= PATH_MAX)
         {
-            if ((f = open(name, O_RDWR, 0644)) != -1)
-            {
-                if ((a = mmap(0, len, prot, MAP_SHARED, f, 0)) != MAP_FAILED)
-                {
-                    d->f = f;
-                    d->a = a;
-                    d->l = l;
-                    d->n = n;
-                    d->m = m;
-                    d->p = p;
-                    d->t = p << (l + l);
-                    d->s = 1 << (    l);
-                    d->h = 1 << (n - l);
-                    d->w = 1 << (m - l);
+            apperr("Stripe directory of %s is too long", name);
+            return -1;
+        }
+        memcpy(dir, dirs, k);
+        dir[k] = 0;
 
-                    return d;
-                }
-                else syserr("Failed to map image %s", name);
-                close(f);
-            }
-            else syserr("Failed to open image %s", name);
-            free(d);
+        if (realpath(dir, res) == NULL)
+        {
+            syserr("Failed to find stripe directory %s", dir);
+            return -1;
         }
-        else syserr("Failed to allocate image  %s", name);
-    }
-    else syserr("Size of %s does not match arguments", name);
+        w = snprintf(list + c, HEADER - STRIPES - c, "%s/%s.%d", res, b, D);
 
-    return 0;
+        if (w < 0 || c + w + 1 >= HEADER - STRIPES)
+        {
+            apperr("Stripe paths of %s are too long", name);
+            return -1;
+        }
+        c    += w + 1;
+        D    += 1;
+        dirs += k;
+
+        if (*dirs == ':')
+            dirs++;
+    }
+    return D;
 }
 
-// Close an image cache file.
+// Read the list of the D files of a striped image from the header page of its
+// file f, confirming that each path lies within it.
 
-void imgclose(img *d)
+static bool imglist(int f, char *list, int D)
 {
-    size_t len = (sizeof (float complex) * d->p) << (d->n + d->m);
-
-    if (munmap(d->a, len) != -1)
+    if (imgxfer(f, list, HEADER - STRIPES, STRIPES, false))
     {
-        close(d->f);
-        free(d);
+        const char *p = list;
+
+        for (int i = 0; i < D && p < list + HEADER - STRIPES; i++)
+            p += strnlen(p, list + HEADER - STRIPES - p) + 1;
+
+        if (p < list + HEADER - STRIPES)
+            return true;
+
+        apperr("Stripe list is malformed");
     }
-    else syserr("Failed to unmap image");
+    else syserr("Failed to read stripe list");
+
+    return false;
 }
 
-//------------------------------------------------------------------------------
+// Create the files of a striped image, and fill them with the repeated N bytes
+// of b through the mapping of the set, unless the value is zero.
+
+static bool imgstripe(const char *list, int D, size_t R, size_t M,
+                                         const void *b, size_t N, bool V)
+{
+    struct stripe *s;
+    void          *a;
+
+    bool ok = false;
+
+    if ((s = stripeopen(list, D, R, M, imgprealloc() ? STRIPE_ALLOCATE
+                                                     : STRIPE_CREATE)))
+    {
+        if (V)
+            ok = true;
+
+        else if ((a = stripemap(s)))
+        {
+            ok = imgfill(-1, (char *) a, 0, b, N, M);
+            munmap(a, M);
+        }
+        stripeclose(s);
+    }
+    return ok;
+}
+
+// Create an image cache file filled with value v. The tile size is resolved
+// and recorded in the header here rather than upon opening. Every tile has the
+// same statistics, so the index is current from the start. A compressed image
+// begins with every frame sharing a single block. Extending the file zeros it
+// without writing, so a cache of zeros is written no further than its header,
+// leaving its index and samples sparse, and any other value is filled in
+// parallel. Given a list of directories, the samples are striped among files
+// in each of them.
+
+bool imginit(const char *name,  // file name
+                    int  l,     // log2 tile size
+                    int  n,     // height
+                    int  m,     // width
+                    int  p,     // pixel size
+                    int  k,     // sample format
+                    int  z,     // compression codec
+                    int  y,     // tile layout
+             const char *dirs,  // stripe directories, or null
+           float complex v)     // value
+{
+    // Allocate and initialize temporary buffers of samples and statistics,
+    // taking the statistics of the value as it is stored.
+
+    const size_t N = 1024;
+    float complex  a[N];
+    float complex  b[N];
+    struct imgstat s[N];
+    char           list[HEADER - STRIPES];
+
+    int D = 0;
+
+    if (dirs && (D = imgpaths(name, dirs, list)) < 0)
+        return false;
+
+    if (l < 0)
+        l = wistile(n, m, p);
+
+    for (size_t i = 0; i < N; i++)
+        a[i] = v;
+
+    imgpack  (k, b, a, N);
+    imgunpack(k, a, b, 1);
+
+    for (size_t i = 0; i < N; i++)
+    {
+        s[i].min = s[i].max = cabsf(a[0]);
+        s[i].lo  = s[i].hi  = crealf(a[0]);
+        s[i].sum = cabsf(a[0]) * (float) (1 << (l + l));
+    }
+
+    // Size the file and write the header, index, and a value for each sample,
+    // or the block table and the one block of a compressed image.
+
+    struct header h = { "GIGO", D ? 5 : y ? 4 : z ? 3 : 2, k, l, n, m, p,
+                                                   0, 0, 1, z, 0, y, D };
+
+    const size_t X = imgidxsize(l, n, m, p);
+    const size_t M = imgsize(k) * p * n * m;
+    const size_t F = imgframe(k, l, p);
+    const size_t Z = z ? ziptable((M + F - 1) / F) : 0;
+    const size_t R = imgrowsize(k, l, m, p);
+    const bool   V = imgzero(b, imgsize(k));
+
+    bool ok = false;
+    int  fd;
+
+    if (HEADER + X + Z > INT_MAX - (2 << 20))
+        apperr("Index of %s is too large, use a larger tile size", name);
+
+    else if (D && z)
+        apperr("Compressed image %s cannot be striped", name);
+
+    else if (D && (R == 0 || R % (size_t) sysconf(_SC_PAGESIZE)))
+        apperr("Tile rows of %s are not whole pages, use a larger tile size",
+                                                                     name);
+    else if ((fd = open(name, O_CREAT | O_TRUNC | O_RDWR, 0644)) != -1)
+    {
+        const size_t u = imghuge(name);
+        const size_t P = u ? u : HEADER;
+        const size_t o = (HEADER + X + Z + P - 1) / P * P;
+        const size_t L = u ? (o + M + u - 1) / u * u : o + (z || D ? 0 : M);
+
+        char *A = NULL;
+
+        h.o = (int) o;
+        h.b = (int) (z ? F : 0);
+
+        if (z && u)
+        {
+            apperr("Compressed image %s cannot be on hugetlbfs", name);
+            unlink(name);
+        }
+        else if (D && u)
+        {
+            apperr("Striped image %s cannot be on hugetlbfs", name);
+            unlink(name);
+        }
+        else if (ftruncate(fd, L) == -1)
+            syserr("Failed to size image %s", name);
+
+        else if (!u && !z && !D && M && imgprealloc() &&
+                 (errno = posix_fallocate(fd, o, (off_t) M)))
+            syserr("Failed to allocate image %s", name);
+
+        else if (u && (A = mmap(0, L, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED, fd, 0)) == MAP_FAILED)
+        {
+            syserr("Failed to map image %s", name);
+            A = NULL;
+        }
+        else if (!(ok = imgrep(fd, A, 0, &h, sizeof (h), sizeof (h)) &&
+                        (!D || imgrep(fd, A, STRIPES, list, sizeof (list),
+                                                            sizeof (list))) &&
+                        (V || imgrep(fd, A, HEADER, s, sizeof (s), X)) &&
+                        (D ? imgstripe(list, D, R, M, b, imgsize(k) * N, V)
+                       : z ? imgzip (fd, HEADER + X, k, F, M, o, b, imgsize(k) * N)
+                       : V || imgfill(fd, A, o, b, imgsize(k) * N, M))))
+            syserr("Failed to write image %s", name);
+
+        if (A) munmap(A, L);
+        close(fd);
+    }
+    else syserr("Failed to open image %s", name);
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+// Allocate the index of image d, and read it if it is current. Mark it stale
+// in the file until the image is closed.
+
+static struct imgidx *imgidxopen(img *d, const struct header *h)
+{
+    const size_t n = (size_t) d->h * d->w;
+
+    struct imgidx *x;
+
+    if ((x = (struct imgidx *) calloc(1, sizeof (struct imgidx))))
+    {
+        if ((x->v = (struct imgstat *) malloc(n * d->p * sizeof (struct imgstat))))
+        {
+            x->w = d->w;
+            x->n = n;
+
+            if (h && h->v >= 2)
+            {
+                x->h = *h;
+                x->f = true;
+                x->x = h->x && imgio(d, x->v, n * d->p * sizeof (struct imgstat),
+                                                              HEADER, false);
+                x->h.x = 0;
+
+                imgio(d, &x->h, sizeof (struct header), 0, true);
+            }
+            return x;
+        }
+        free(x);
+    }
+    return NULL;
+}
+
+// Write back the header and index of image d, with the index current if every
+// tile was tallied, or if the image was unchanged and the index was current.
+
+static void imgidxclose(img *d)
+{
+    struct imgidx *x = d->x;
+
+    if (x->f)
+    {
+        if (x->c >= x->n)
+            x->h.x = imgio(d, x->v, x->n * d->p * sizeof (struct imgstat),
+                                                         HEADER, true);
+        else
+            x->h.x = x->k && x->x;
+
+        x->h.e = d->e;
+
+        imgio(d, &x->h, sizeof (struct header), 0, true);
+    }
+    free(x->v);
+    free(x);
+}
+
+// Note that image d is unchanged, and that its index remains as current as it
+// was when opened.
+
+void imgkeep(img *d)
+{
+    if (d->x)
+        d->x->k = true;
+}
+
+// Determine whether the index of image d was current when opened.
+
+bool imgindexed(const img *d)
+{
+    return d->x && d->x->x;
+}
+
+// Give the statistics of each channel of tile (r, c), or null if not indexed.
+
+const struct imgstat *imgstats(const img *d, int r, int c)
+{
+    return d->x ? d->x->v + ((size_t) d->x->w * r + c) * d->p : NULL;
+}
+
+// Record the statistics of tile (r, c), given its samples as complex float. A
+// tool that tallies every tile of the image that it writes keeps the index
+// current. Tiles are tallied concurrently, each by one thread.
+
+void imgtally(img *d, int r, int c, const float complex *z)
+{
+    struct imgidx *x = d->x;
+
+    if (x)
+    {
+        struct imgstat *s = x->v + ((size_t) x->w * r + c) * d->p;
+
+        const int n = d->s * d->s;
+
+        for (int k = 0; k < d->p; k++)
+        {
+            double t = 0.0;
+
+            s[k].min = s[k].lo =  FLT_MAX;
+            s[k].max = s[k].hi = -FLT_MAX;
+
+            for (int i = 0; i < n; i++)
+            {
+                const float complex v = z[imgco(d, (size_t) i * d->g, k)];
+                const float         a = cabsf (v);
+                const float         b = crealf(v);
+
+                t += a;
+
+                if (s[k].min > a) s[k].min = a;
+                if (s[k].max < a) s[k].max = a;
+                if (s[k].lo  > b) s[k].lo  = b;
+                if (s[k].hi  < b) s[k].hi  = b;
+            }
+            s[k].sum = (float) t;
+        }
+        __sync_fetch_and_add(&x->c, 1);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Map len bytes of image file f, with samples beginning at offset o, and give
+// a pointer to the samples. If the environment variable GIGO_POOL gives a
+// memory cap, page the samples through a buffer pool of tile-sized frames
+// rather than leaving residency to the kernel. A compressed image z cannot be
+// mapped, and is always paged through a pool, by default one large enough to
+// hold the whole image. A striped image v is mapped or paged from its files.
+
+static void *imgmap(const char *name, int f, size_t len, int o, size_t t,
+              size_t u, struct zip *z, struct stripe *v, struct pool **q)
+{
+    const char *e = getenv("GIGO_POOL");
+    void       *a;
+    size_t      c = len - o;
+
+    *q = NULL;
+
+    if ((e && *e) || z)
+    {
+        if (e && *e && (c = strtosize(e)) == 0)
+            apperr("Malformed GIGO_POOL %s", e);
+
+        else if (u)
+            apperr("Buffer pool cannot page hugetlbfs image %s", name);
+
+        else if ((*q = poolopen(f, o, len - o, t, c,
+                                z ? zipio : v ? stripeio : NULL,
+                                z ? (void *) z : (void *) v)))
+            return poolptr(*q);
+
+        return NULL;
+    }
+    if (v)
+    {
+        if ((a = stripemap(v)))
+        {
+            if (imghugemode())
+                madvise(a, len - o, MADV_HUGEPAGE);
+
+            return a;
+        }
+    }
+    else if ((a = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0))
+                                                           != MAP_FAILED)
+    {
+        if (imghugemode() && !u)
+            madvise(a, len, MADV_HUGEPAGE);
+
+        return (char *) a + o;
+    }
+
+    syserr("Failed to map image %s", name);
+    return NULL;
+}
+
+// Open an image cache file and return a new img structure. A cache with a
+// header gives its own format, tile size, and domain, and the arguments must
+// agree with it. Otherwise, a negative tile size selects the one recorded in
+// the wisdom file for the image size, as an image must be read with the tile
+// size with which it was written. Every image has an index in memory, though
+// only a cache with a version 2 header has space to keep it. The size of a
+// compressed cache varies with its contents, and its frames must be whole
+// pages on this system. The samples of a striped cache lie in other files,
+// and so begin at offset zero of the image's memory.
+
+// Set the tiling of image d to log2 tile size l, with tile layout y.
+
+static void imgshape(img *d, int l, int y)
+{
+    d->l = l;
+    d->t = d->p << (l + l);
+    d->s = 1    << (    l);
+    d->g = (y == IMG_PLANAR) ? 1 : d->p;
+    d->c = (y == IMG_PLANAR) ? 1 << (l + l) : 1;
+    d->h = d->n >> l;
+    d->w = d->m >> l;
+}
+
+// Give the tile layout of image d. The layouts of single-sample images agree.
+
+int imglayout(const img *d)
+{
+    return (d->p > 1 && d->g == 1) ? IMG_PLANAR : IMG_INTERLEAVED;
+}
+
+img *imgopen(const char *name,  // file name
+                    int  l,     // log2 tile size
+                    int  n,     // height
+                    int  m,     // width
+                    int  p)     // pixel size
+{
+    struct header h;
+
+    const bool   H = imghead(name, &h);
+    const int    k = H ? h.k : IMG_C32;
+    const int    o = H ? (h.o ? h.o : HEADER) : 0;
+    const bool   Z = H && h.v >= 3 && h.z;
+    const bool   Y = H && h.v >= 4 && h.y == IMG_PLANAR;
+    const int    D = H && h.v >= 5 ? h.d : 0;
+    const size_t u = imghuge(name);
+
+    if (l < 0)
+        l = H ? h.l : wistile(n, m, p);
+
+    size_t len = o + imgsize(k) * p * n * m;
+    struct stat buf;
+
+    if (u)
+        len = (len + u - 1) / u * u;
+
+    int    f;
+    img   *d;
+    void  *a;
+
+    if (H && (h.l != l || h.n != n || h.m != m || h.p != p))
+        apperr("Header of %s does not match arguments", name);
+
+    else if (n % (1 << l) || m % (1 << l))
+        apperr("Size of %s is not a multiple of the tile size", name);
+
+    else if (k < IMG_C32 || k > IMG_R32)
+        apperr("Sample format of %s is not supported", name);
+
+    else if (H && h.v >= 4 && h.y != IMG_INTERLEAVED && h.y != IMG_PLANAR)
+        apperr("Tile layout of %s is not supported", name);
+
+    else if (Z && (h.z != ZIP_ZLIB || (size_t) h.b != imgframe(k, l, p)))
+        apperr("Compression of %s is not supported", name);
+
+    else if (D < 0 || (D && (Z || u)))
+        apperr("Striping of %s is not supported", name);
+
+    else if (stat(name, &buf) != -1 && (Z ? buf.st_size >= o
+                                      : D ? buf.st_size == o
+                                          : buf.st_size == len))
+    {
+        if ((d = (img *) malloc(sizeof (img))))
+        {
+            if ((f = open(name, O_RDWR, 0644)) != -1)
+            {
+                const size_t M = len - o;
+                const size_t F = imgframe(k, l, p);
+
+                char list[HEADER - STRIPES];
+
+                d->z = Z ? zipopen(f, HEADER + imgidxsize(l, n, m, p),
+                                   (M + F - 1) / F, F, imgword(k)) : NULL;
+                d->v = D && imglist(f, list, D)
+                         ? stripeopen(list, D, imgrowsize(k, l, m, p), M,
+                                                    STRIPE_OPEN) : NULL;
+
+                if ((d->z || !Z) && (d->v || !D) &&
+                    (a = imgmap(name, f, len, o, imgsize(k) * (p << (l + l)),
+                                                     u, d->z, d->v, &d->q)))
+                {
+                    d->f = f;
+                    d->a = a;
+                    d->n = n;
+                    d->m = m;
+                    d->p = p;
+                    d->k = k;
+                    d->o = D ? 0 : o;
+                    d->u = (int) u;
+                    d->e = H && h.v >= 2 ? h.e : 0;
+
+                    imgshape(d, l, Y ? IMG_PLANAR : IMG_INTERLEAVED);
+
+                    d->x = imgidxopen(d, H ? &h : NULL);
+
+                    return d;
+                }
+                if (d->z) zipclose(d->z);
+                if (d->v) stripeclose(d->v);
+                close(f);
+            }
+            else syserr("Failed to open image %s", name);
+            free(d);
+        }
+        else syserr("Failed to allocate image  %s", name);
+    }
+    else syserr("Size of %s does not match arguments", name);
+
+    return 0;
+}
+
+// Close an image cache file, writing back its header and index and any dirty
+// frames of its pool, and then the block table of a compressed image, and
+// release the files of a striped image.
+
+void imgclose(img *d)
+{
+    size_t len = d->o + imgsize(d->k) * d->p * d->n * d->m;
+
+    if (d->u)
+        len = (len + d->u - 1) / d->u * d->u;
+
+    if (d->x)
+        imgidxclose(d);
+
+    if (d->q ? poolclose(d->q) : munmap((char *) d->a - d->o, len) != -1)
+    {
+        if (d->z)
+            zipclose(d->z);
+        if (d->v)
+            stripeclose(d->v);
+
+        close(d->f);
+        free(d);
+    }
+    else syserr("Failed to close image");
+}
+
+//------------------------------------------------------------------------------
+
+// Copy the samples of image s to image d of the same size, converting them to
+// the format of d, and tally each tile of d as written.
+
+static bool imgcopy(img *d, img *s)
+{
+    const size_t n = (size_t) d->t;
+
+    float complex **a;
+    float complex  *D;
+    float complex  *S;
+
+    int y;
+    int x;
+
+    if (!(a = (float complex **) imgallocs(sizeof (float complex) * n * 2)))
+    {
+        syserr("Failed to allocate tile buffers");
+        return false;
+    }
+
+    #pragma omp parallel for schedule(static) private(x, D, S)
+    for     (y = 0; y < d->h; y++)
+    {
+        imgfetch(s, y + 1, 0, 1, s->w);
+
+        for (x = 0; x < d->w; x++)
+        {
+            D = (d->k == IMG_C32) ? imgbuf(d, y, x, 0, 0)
+                                  : a[omp_get_thread_num()];
+            S = imgwiden(s, y, x,   a[omp_get_thread_num()] + n);
+
+            memcpy(D, S, sizeof (float complex) * n);
+
+            imgnarrow(d, y, x, D);
+            imgtally (d, y, x, imgwiden(d, y, x, D));
+        }
+    }
+
+    imgfrees((void **) a, sizeof (float complex) * n * 2);
+    return true;
+}
+
+// Copy the samples of image s to image d of the same size and format but of
+// another tile size, tallying each tile as written to image e, which gives the
+// tiling of d. The samples go in bands of pixel rows as high as the larger
+// tile, each of which is a single run of samples in either tiling, so that each
+// band is read and written whole and rearranged in memory, one tile row of the
+// smaller tile at a time. The bands go round two pairs of buffers, the next
+// read and the last written while one is rearranged. Image d may be image s
+// itself, retiled in place, with e giving its new tiling.
+
+static bool imgbands(img *d, img *s, img *e)
+{
+    const int    B = 1 << max(s->l, e->l);
+    const int    q = 1 << min(s->l, e->l);
+    const int    K = (imglayout(s) == IMG_PLANAR) ? s->p : 1;
+    const int    T = (B >> e->l) * e->w;
+    const size_t z = imgsize(s->k);
+    const size_t S = z * s->p * s->m * B;
+    const size_t Q = z * q * s->p / K;
+
+    char           *in [2] = { NULL, NULL };
+    char           *out[2] = { NULL, NULL };
+    float complex **a;
+
+    bool ok = true;
+    int  b;
+    int  i;
+    int  y;
+    int  x;
+    int  k;
+
+    for (int j = 0; j < 2; j++)
+    {
+        in [j] = (char *) imgalloc(S);
+        out[j] = (char *) imgalloc(S);
+    }
+    a = (float complex **) imgallocs(sizeof (float complex) * e->t);
+
+    if (!in[0] || !in[1] || !out[0] || !out[1] || !a)
+    {
+        syserr("Failed to allocate band buffers");
+        ok = false;
+    }
+    else ok = imgpost(s, 0, 0, B >> s->l, s->w, in[0], false, 1);
+
+    for (b = 0; ok && b < s->n / B; b++)
+    {
+        const int j = b % 2;
+
+        if (!(ok = imgwait(j + 1)))
+            break;
+
+        if (b + 1 < s->n / B && !(ok = imgpost(s, (b + 1) * (B >> s->l), 0,
+                                                B >> s->l, s->w,
+                                                in[1 - j], false, 2 - j)))
+            break;
+
+        #pragma omp parallel for schedule(static) private(x, k)
+        for         (y = 0; y < B;    y++)
+            for     (x = 0; x < s->m; x += q)
+                for (k = 0; k < K;    k++)
+                    memcpy(out[j] + z * imgco(e, imgzo(e, y, x), k),
+                           in [j] + z * imgco(s, imgzo(s, y, x), k), Q);
+
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < T; i++)
+        {
+            char          *t = out[j] + z * e->t * i;
+            float complex *w = (float complex *) t;
+
+            if (e->k != IMG_C32)
+                imgunpack(e->k, w = a[omp_get_thread_num()], t, e->t);
+
+            imgtally(e, b * (B >> e->l) + i / e->w, i % e->w, w);
+        }
+
+        ok = imgpost(d, b * (B >> d->l), 0, B >> d->l, d->w, out[j], true,
+                                                                   j + 1);
+    }
+    ok = imgwait(1) && ok;
+    ok = imgwait(2) && ok;
+
+    for (int j = 0; j < 2; j++)
+    {
+        imgfree(in [j], S);
+        imgfree(out[j], S);
+    }
+    imgfrees((void **) a, sizeof (float complex) * e->t);
+    return ok;
+}
+
+// Give the sample format of the named image cache, or -1 if it has no header.
+
+int imgformat(const char *name)
+{
+    struct header h;
+
+    return imghead(name, &h) ? h.k : -1;
+}
+
+// Give the directories of the D files of striped image f, separated by colons,
+// along with the list of the files, so that a copy may be striped alike.
+
+static bool imgdirs(int f, int D, char *list, char *dirs)
+{
+    if (imglist(f, list, D))
+    {
+        const char *q = list;
+
+        for (int i = 0; i < D; i++, q += strlen(q) + 1)
+        {
+            const char  *e = strrchr(q, '/');
+            const size_t k = (e && e > q) ? (size_t) (e - q) : 1;
+
+            memcpy(dirs, q, k);
+            dirs   += k;
+            *dirs++ = (i + 1 < D) ? ':' : 0;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Move the D files of striped image tmp over those of the given list, and give
+// it that list, or remove them if the image is to be discarded.
+
+static bool imgmove(const char *tmp, const char *list, int D, bool ok)
+{
+    char from[HEADER - STRIPES];
+    int  f;
+
+    if ((f = open(tmp, O_RDWR)) != -1)
+    {
+        if (imglist(f, from, D))
+        {
+            const char *a = from;
+            const char *b = list;
+
+            for (int i = 0; i < D; i++, a += strlen(a) + 1, b += strlen(b) + 1)
+                if (ok && rename(a, b) == -1)
+                {
+                    syserr("Failed to replace stripe %s", b);
+                    ok = false;
+                }
+                else if (!ok)
+                    unlink(a);
+
+            if (ok && !imgxfer(f, (char *) list, HEADER - STRIPES, STRIPES,
+                                                                   true))
+            {
+                syserr("Failed to write stripe list of %s", tmp);
+                ok = false;
+            }
+        }
+        else ok = false;
+
+        close(f);
+    }
+    else ok = false;
+
+    return ok;
+}
+
+// Rewrite the named image cache in sample format k and with log2 tile size L,
+// either of which may be negative to keep it. Only one may change at a time. A
+// new cache with the same layout, domain, compression, and striping is written
+// beside it and then renamed to replace it, so that an image is never left half
+// converted. The files of a striped image are replaced just before it.
+
+static bool imgreplace(const char *name, int l, int n, int m, int p, int k,
+                                                                    int L)
+{
+    char tmp[PATH_MAX];
+    char list[HEADER - STRIPES];
+    char dirs[HEADER - STRIPES];
+    bool ok = false;
+    bool c  = false;
+    int  D  = 0;
+    img *s;
+    img *d;
+
+    struct header h;
+
+    if ((s = imgopen(name, l, n, m, p)))
+    {
+        imgkeep(s);
+
+        if (k < 0) k = s->k;
+        if (L < 0) L = s->l;
+
+        if (s->v && imghead(name, &h))
+            D = h.d;
+
+        if (s->k == k && s->l == L)
+            ok = true;
+
+        else if (snprintf(tmp, PATH_MAX, "%s.tmp", name) >= PATH_MAX)
+            apperr("Image name %s is too long", name);
+
+        else if (D && !imgdirs(s->f, D, list, dirs))
+            ok = false;
+
+        else if ((c = imginit(tmp, L, n, m, p, k, s->z ? ZIP_ZLIB : ZIP_NONE,
+                                   imglayout(s), D ? dirs : NULL, 0)))
+        {
+            if ((d = imgopen(tmp, L, n, m, p)))
+            {
+                imghint(s, IMG_SEQUENTIAL);
+                imghint(d, IMG_SEQUENTIAL);
+
+                if ((ok = (s->l == L) ? imgcopy(d, s) : imgbands(d, s, d)))
+                    d->e = s->e;
+
+                imgclose(d);
+            }
+        }
+        imgclose(s);
+    }
+
+    if (c)
+    {
+        if (D)
+            ok = imgmove(tmp, list, D, ok);
+
+        if (ok && rename(tmp, name) == -1)
+        {
+            syserr("Failed to replace image %s", name);
+            ok = false;
+        }
+        if (!ok)
+            unlink(tmp);
+    }
+    return ok;
+}
+
+bool imgconvert(const char *name, int l, int n, int m, int p, int k)
+{
+    return imgreplace(name, l, n, m, p, k, -1);
+}
+
+// Retile the named image cache to log2 tile size L in place, rearranging each
+// band of its samples where it lies, and giving it an index of the new tiles in
+// place of the old. The image is unusable if this is interrupted.
+
+static bool imginplace(const char *name, int l, int n, int m, int p, int L)
+{
+    bool ok = false;
+    img *s;
+    img  e;
+
+    if ((s = imgopen(name, l, n, m, p)))
+    {
+        e = *s;
+
+        imgshape(&e, L, imglayout(s));
+
+        if (s->l == L)
+        {
+            imgkeep(s);
+            ok = true;
+        }
+        else if (s->x == NULL || (e.x = imgidxopen(&e, NULL)) == NULL)
+            syserr("Failed to allocate index of %s", name);
+
+        else
+        {
+            imghint(s, IMG_SEQUENTIAL);
+
+            if ((ok = imgbands(s, s, &e)))
+            {
+                e.x->h   = s->x->h;
+                e.x->h.l = L;
+                e.x->f   = s->x->f;
+
+                free(s->x->v);
+                free(s->x);
+
+                imgshape(s, L, imglayout(s));
+                s->x = e.x;
+            }
+            else
+            {
+                apperr("Image %s is left partly retiled", name);
+                free(e.x->v);
+                free(e.x);
+            }
+        }
+        imgclose(s);
+    }
+    return ok;
+}
+
+// Retile the named image cache to log2 tile size L, or to the size the planner
+// prefers if L is negative, writing the result to a new cache named out, with
+// the same format, layout, and compression, striped among the directories dirs
+// if given. Without out, retile the cache in place where its index of the new
+// tiles fits before its samples and it is neither compressed nor striped, and
+// otherwise replace it with a retiled copy.
+
+bool imgretile(const char *name, int l, int n, int m, int p, int L,
+                                   const char *out, const char *dirs)
+{
+    struct header h;
+
+    const bool H = imghead(name, &h);
+    const int  o = H ? (h.o ? h.o : HEADER) : 0;
+
+    bool ok = false;
+    img *s;
+    img *d;
+
+    if (L < 0)
+        L = wistile(n, m, p);
+
+    if (n % (1 << L) || m % (1 << L))
+        apperr("Size of %s is not a multiple of the tile size", name);
+
+    else if (out == NULL)
+    {
+        if (!H || (h.v >= 2 && !(h.v >= 3 && h.z) && !(h.v >= 5 && h.d)
+                            && HEADER + imgidxsize(L, n, m, p) <= (size_t) o))
+            ok = imginplace(name, l, n, m, p, L);
+        else
+            ok = imgreplace(name, l, n, m, p, -1, L);
+    }
+
+    else if ((s = imgopen(name, l, n, m, p)))
+    {
+        imgkeep(s);
+
+        if (imginit(out, L, n, m, p, s->k, s->z ? ZIP_ZLIB : ZIP_NONE,
+                                     imglayout(s), dirs, 0))
+        {
+            if ((d = imgopen(out, L, n, m, p)))
+            {
+                imghint(s, IMG_SEQUENTIAL);
+                imghint(d, IMG_SEQUENTIAL);
+
+                if ((ok = (s->l == L) ? imgcopy(d, s) : imgbands(d, s, d)))
+                    d->e = s->e;
+
+                imgclose(d);
+            }
+            if (!ok)
+                unlink(out);
+        }
+        imgclose(s);
+    }
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+// Block transfers go through an I/O queue of the calling thread, which keeps
+// many pieces of them in flight at once, as selected by the environment
+// variable GIGO_AIO: "uring" (the default) uses io_uring where the kernel
+// allows it, and "sync" transfers each piece at once with pread and pwrite.
+
+#define AIO_URING 0
+#define AIO_SYNC  1
+
+static int imgaiomode(void)
+{
+    static int mode = -1;
+
+    if (mode < 0)
+    {
+        const char *e = getenv("GIGO_AIO");
+
+        mode = AIO_URING;
+
+        if (e)
+        {
+            if      (strcmp(e, "uring") == 0) mode = AIO_URING;
+            else if (strcmp(e, "sync")  == 0) mode = AIO_SYNC;
+            else apperr("GIGO_AIO %s is not recognized", e);
+        }
+    }
+    return mode;
+}
+
+static struct aio *imgaio(void)
+{
+    static __thread struct aio *q = NULL;
+    static __thread bool        k = false;
+
+    if (!k)
+    {
+        q = (imgaiomode() == AIO_URING) ? aioopen() : NULL;
+        k = true;
+    }
+    return q;
+}
+
+// Begin the transfer of len bytes between buffer and the samples of image d at
+// byte a through queue q in group g, locating the pieces of a striped image.
+
+static bool imgpiece(img *d, struct aio *q, int g, char *buf, size_t len,
+                                                    size_t a, bool out)
+{
+    int    f;
+    off_t  o;
+    size_t n;
+
+    if (d->v == NULL)
+        return aioxfer(q, g, d->f, buf, len, (off_t) a + d->o, out);
+
+    while (len > 0)
+    {
+        n = stripefind(d->v, a, &f, &o);
+        n = (len < n) ? len : n;
+
+        if (!aioxfer(q, g, f, buf, n, o, out))
+            return false;
+
+        buf += n;
+        len -= n;
+        a   += n;
+    }
+    return true;
+}
+
+// Begin to transfer a block of h rows of w tiles, with upper-left tile (r, c),
+// between the image file and a buffer in which the block's tiles are packed
+// row-major, in group g of the queue of the calling thread. Each row of tiles
+// is one sequential transfer, as is a full-width block. The tiles of a
+// compressed image are copied through its pool instead, in parallel so that
+// they are decoded and encoded in parallel, as are the rows of a striped image
+// if there is no queue, so that its files are read and written at once. A
+// cache on hugetlbfs is copied through its mapping.
+
+static bool imgblock(img *d, int r, int c, int h, int w, char *buf, bool out,
+                                                                   int g)
+{
+    const size_t t = imgsize(d->k) * d->t;
+
+    struct aio *q = d->u ? NULL : imgaio();
+
+    if (d->z)
+    {
+        int i;
+
+        #pragma omp parallel for
+        for (i = 0; i < h * w; i++)
+        {
+            char *a = (char *) d->a + t * ((size_t) d->w * (r + i / w)
+                                                         + (c + i % w));
+            if (out)
+                memcpy(a, buf + t * i, t);
+            else
+                memcpy(buf + t * i, a, t);
+        }
+        return true;
+    }
+
+    if (d->v && !(q && aioasync(q)))
+    {
+        long e = 0;
+        int  i;
+
+        #pragma omp parallel for reduction(+:e)
+        for (i = 0; i < h; i++)
+            if (!stripexfer(d->v, buf + t * w * i, t * w,
+                            t * ((size_t) d->w * (r + i) + c), out))
+                e++;
+
+        return (e == 0);
+    }
+
+    if (w == d->w)
+    {
+        w = w * h;
+        h = 1;
+    }
+
+    for (int i = 0; i < h; i++)
+    {
+        const size_t a = t * ((size_t) d->w * (r + i) + c);
+
+        if (!(q ? imgpiece(d, q, g, buf + t * w * i, t * w, a, out)
+                : imgio   (d,       buf + t * w * i, t * w,
+                                              (off_t) a + d->o, out)))
+            return false;
+    }
+    return true;
+}
+
+// Give the byte range of the samples spanned by a block of tiles.
+
+static void imgspan(img *d, int r, int c, int h, int w, size_t *a, size_t *b)
+{
+    const size_t t = imgsize(d->k) * d->t;
+
+    *a = t * ((size_t) d->w * (r        ) + c    );
+    *b = t * ((size_t) d->w * (r + h - 1) + c + w);
+}
+
+// Begin to read or write a block of tiles, bypassing the mapping, in group g
+// of AIO_GROUPS, to be awaited with imgwait. Neither the buffer nor the
+// tiles may be touched until then. Before a read, a pool must write back
+// anything it holds dirty there, and with a write, it must drop anything it
+// holds there, which is stale, unless it is the only route to the samples of a
+// compressed image.
+
+bool imgpost(img *d, int r, int c, int h, int w, void *buf, bool out, int g)
+{
+    size_t a;
+    size_t b;
+
+    imgspan(d, r, c, h, w, &a, &b);
+
+    if (d->q && !d->z && !out && !poolsync(d->q, a, b))
+        return false;
+
+    if (imgblock(d, r, c, h, w, (char *) buf, out, g))
+    {
+        if (d->q && !d->z && out)
+            pooldrop(d->q, a, b);
+        return true;
+    }
+
+    syserr(out ? "Failed to write image tiles" : "Failed to read image tiles");
+    return false;
+}
+
+// Wait for the transfers of group g begun by the calling thread to complete.
+
+bool imgwait(int g)
+{
+    struct aio *q = imgaio();
+
+    if (q == NULL || aiowait(q, g))
+        return true;
+
+    syserr("Failed to transfer image tiles");
+    return false;
+}
+
+// Read or write a block of tiles and wait for it.
+
+bool imgload(img *d, int r, int c, int h, int w, void *buf)
+{
+    return imgpost(d, r, c, h, w, buf, false, 0) && imgwait(0);
+}
+
+bool imgstore(img *d, int r, int c, int h, int w, const void *buf)
+{
+    return imgpost(d, r, c, h, w, (void *) buf, true, 0) && imgwait(0);
+}
+
+//------------------------------------------------------------------------------
+
+// Declare the pattern of the coming accesses to the image, to tune the kernel's
+// readahead of both the mapping and the file. A column-wise sweep touches one
+// tile per row of tiles, which sequential readahead only wastes effort upon.
+
+void imghint(img *d, int how)
+{
+    static const int madv[] = {
+        POSIX_MADV_NORMAL, POSIX_MADV_SEQUENTIAL, POSIX_MADV_RANDOM
+    };
+    static const int fadv[] = {
+        POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM
+    };
+    size_t len = d->o + imgsize(d->k) * d->p * d->n * d->m;
+
+    if (d->q == NULL)
+        posix_madvise((char *) d->a - d->o, len, madv[how]);
+
+    if (d->v)
+        stripehint(d->v, fadv[how]);
+    else
+        posix_fadvise(d->f, 0, len, fadv[how]);
+}
+
+// Begin reading a block of h rows of w tiles, with upper-left tile (r, c), into
+// the page cache without waiting for it. The block is clipped to the image, so
+// a sweep may ask for the tiles following its last without care. A compressed
+// image reads ahead the blocks of the frames spanned.
+
+void imgfetch(img *d, int r, int c, int h, int w)
+{
+    const size_t t = imgsize(d->k) * d->t;
+
+    h = min(h, d->h - r);
+    w = min(w, d->w - c);
+
+    if (r < 0 || c < 0 || h <= 0 || w <= 0)
+        return;
+
+    if (w == d->w)
+    {
+        w = w * h;
+        h = 1;
+    }
+
+    for (int i = 0; i < h; i++)
+    {
+        const size_t a = t * ((size_t) d->w * (r + i) + c);
+
+        if (d->z)
+            zipfetch(d->z, a, a + t * w);
+        else if (d->v)
+            stripefetch(d->v, a, a + t * w);
+        else
+            posix_fadvise(d->f, (off_t) a + d->o, (off_t) t * w,
+                                                  POSIX_FADV_WILLNEED);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Return the samples of tile (r, c) as complex float. A complex float image
+// gives its mapping directly. A narrow image is widened into buffer buf, which
+// must hold one tile.
+
+float complex *imgwiden(img *d, int r, int c, float complex *buf)
+{
+    if (d->k == IMG_C32)
+        return imgbuf(d, r, c, 0, 0);
+
+    imgunpack(d->k, buf, (char *) d->a + imgsize(d->k) * imgbo(d, r, c, 0, 0),
+                                                            d->t);
+    return buf;
+}
+
+// Narrow a tile given by imgwiden back into the image, if necessary.
+
+void imgnarrow(img *d, int r, int c, float complex *buf)
+{
+    if (d->k != IMG_C32)
+        imgpack(d->k, (char *) d->a + imgsize(d->k) * imgbo(d, r, c, 0, 0),
+                                                       buf, d->t);
+}
@@ -15,75 +15,283 @@
 
 #include <complex.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "vec.h"
 
 //------------------------------------------------------------------------------
 
+struct pool;
+struct imgidx;
+struct stripe;
+struct zip;
+
 struct img
 {
     int   f;  // file descriptor
     void *a;  // data pointer
     int   l;  // log2 tile size
-    int   n;  // log2 height
-    int   m;  // log2 width
+    int   n;  // height (in pixels)
+    int   m;  // width  (in pixels)
     int   p;  // pixel size (in samples)
     int   t;  // tile  size (in samples)
     int   s;  // tile size 2^l
+    int   g;  // pixel stride within a tile (in samples)
+    int   c;  // channel stride within a tile (in samples)
     int   h;  // tile array height
     int   w;  // tile array width
+    int   k;  // sample format
+    int   o;  // data offset (in bytes)
+    int   u;  // huge page size of hugetlbfs, or zero
+    int   e;  // domain
+
+    struct imgidx *x; // tile statistics index
+
+    struct pool   *q; // buffer pool, or null if mapped
+    struct zip    *z; // compressed block table, or null if not compressed
+    struct stripe *v; // stripe set, or null if the samples follow the header
 };
 
 typedef struct img img;
 
 //------------------------------------------------------------------------------
 
+// Image sizes are given on the command line as log2, for powers of two, or as
+// pixel counts of 32 or more. Convert such an argument to pixels, leaving zero
+// unspecified, and convert a pixel count back to an argument.
+
+static inline int imgdim(long n)
+{
+    return (0 < n && n < 32) ? 1 << n : (int) n;
+}
+
+static inline int imgarg(int n)
+{
+    int l = 0;
+
+    if (n > 0 && (n & (n - 1)) == 0)
+    {
+        while (n >>= 1)
+            l++;
+        return l;
+    }
+    return n;
+}
+
+//------------------------------------------------------------------------------
+
+// Samples are complex float, or complex IEEE half or bfloat16 at half the size,
+// or real float at half the size for images of the spatial domain. Narrow and
+// real samples are widened to complex float as they are read and narrowed again
+// as they are written, and all arithmetic is done in complex float.
+
+enum
+{
+    IMG_C32,
+    IMG_F16,
+    IMG_B16,
+    IMG_R32,
+};
+
+int imgfmt(const char *name);
+
+// A sweep may declare its access pattern, and ask for the tiles it will touch
+// next to begin loading while it works on those it has.
+
+enum
+{
+    IMG_NORMAL,
+    IMG_SEQUENTIAL,
+    IMG_RANDOM,
+};
+
+// The samples of each pixel of a tile are adjacent by default. A planar tile
+// instead gives each channel a plane of its own, so that every row of a channel
+// within a tile is a contiguous run.
+
+enum
+{
+    IMG_INTERLEAVED,
+    IMG_PLANAR,
+};
+
+int imglayout(const img *d);
+
+static inline size_t imgsize(int k)
+{
+    return (k == IMG_C32) ? sizeof (float complex) : sizeof (float complex) / 2;
+}
+
+//------------------------------------------------------------------------------
+
+// The domain records which of the rows and columns of an image have been
+// transformed to the frequency domain, and so is zero for a spatial image.
+
+enum
+{
+    IMG_ROWS = 1,
+    IMG_COLS = 2,
+};
+
+// The index records statistics of each channel of each tile: the least and
+// greatest magnitude, the sum of magnitudes, and the least and greatest real
+// part. Tools that write every tile tally each as they go.
+
+struct imgstat
+{
+    float min;
+    float max;
+    float sum;
+    float lo;
+    float hi;
+};
+
+void                  imgkeep   (img *d);
+bool                  imgindexed(const img *d);
+const struct imgstat *imgstats  (const img *d, int r, int c);
+void                  imgtally  (img *d, int r, int c, const float complex *z);
+
+//------------------------------------------------------------------------------
+
 bool imgargs(const char *name, int *n, int *m, int *p);
 
-bool imginit(const char *name, int l, int n, int m, int p, float complex v);
+bool imginit(const char *name, int l, int n, int m, int p, int k, int z,
+                                     int y, const char *s, float complex v);
 img *imgopen(const char *name, int l, int n, int m, int p);
 
+int  imgformat (const char *name);
+bool imgconvert(const char *name, int l, int n, int m, int p, int k);
+bool imgretile (const char *name, int l, int n, int m, int p, int L,
+                                    const char *out, const char *dirs);
+
 void imgclose(img *d);
 
+void  *imgalloc (size_t n);
+void   imgfree  (void *a, size_t n);
+void **imgallocs(size_t n);
+void   imgfrees (void **a, size_t n);
+
+bool imgload (img *d, int r, int c, int h, int w,       void *buf);
+bool imgstore(img *d, int r, int c, int h, int w, const void *buf);
+bool imgpost (img *d, int r, int c, int h, int w,       void *buf,
+                                                  bool out, int g);
+bool imgwait (int g);
+
+void imghint (img *d, int how);
+void imgfetch(img *d, int r, int c, int h, int w);
+
+float complex *imgwiden (img *d, int r, int c, float complex *buf);
+void           imgnarrow(img *d, int r, int c, float complex *buf);
+
 //------------------------------------------------------------------------------
 
-static inline float complex *imgz(img *d, int y, int x)
+// Index the first sample of pixel (y, x), or of pixel (i, j) of tile (r, c),
+// and sample k of the pixel whose first sample is o.
+
+static inline size_t imgzo(const img *d, int y, int x)
 {
     const int c = x >> d->l, j = x & (d->s - 1);
     const int r = y >> d->l, i = y & (d->s - 1);
 
-    return (float complex *) d->a + ((size_t) d->w * r + c) * d->t
-                                  + ((size_t) d->s * i + j) * d->p;
+    return ((size_t) d->w * r + c) * d->t + ((size_t) d->s * i + j) * d->g;
+}
+
+static inline size_t imgbo(const img *d, int r, int c, int i, int j)
+{
+    return ((size_t) d->w * r + c) * d->t + ((size_t) d->s * i + j) * d->g;
+}
+
+static inline size_t imgco(const img *d, size_t o, int k)
+{
+    return o + (size_t) d->c * k;
+}
+
+// As a sweep of pixel rows enters a row of tiles at row y, fetch the next row
+// of tiles spanning columns x through x + w - 1.
+
+static inline void imgnext(img *d, int y, int x, int w)
+{
+    if ((y & (d->s - 1)) == 0)
+        imgfetch(d, (y >> d->l) + 1, x >> d->l, 1,
+                    ((x + w - 1) >> d->l) - (x >> d->l) + 1);
+}
+
+// Point directly to a sample. This is valid only for complex float images.
+
+static inline float complex *imgz(img *d, int y, int x)
+{
+    return (float complex *) d->a + imgzo(d, y, x);
 }
 
 static inline float complex *imgbuf(img *d, int r, int c, int i, int j)
 {
-    return (float complex *) d->a + ((size_t) d->w * r + c) * d->t
-                                  + ((size_t) d->s * i + j) * d->p;
+    return (float complex *) d->a + imgbo(d, r, c, i, j);
+}
+
+// Point directly to row i of channel k of tile (r, c) of a planar image, a run
+// of s samples. This too is valid only for complex float images.
+
+static inline float complex *imgrow(img *d, int r, int c, int i, int k)
+{
+    return (float complex *) d->a + imgco(d, imgbo(d, r, c, i, 0), k);
+}
+
+// Read and write sample o in any format.
+
+static inline float complex imgval(const img *d, size_t o)
+{
+    const unsigned short *a = (const unsigned short *) d->a + 2 * o;
+
+    float complex z;
+    float        *f = (float *) &z;
+
+    switch (d->k)
+    {
+        case IMG_F16: f[0] = htof(a[0]); f[1] = htof(a[1]); return z;
+        case IMG_B16: f[0] = btof(a[0]); f[1] = btof(a[1]); return z;
+        case IMG_R32: return ((const float *) d->a)[o];
+    }
+    return ((const float complex *) d->a)[o];
+}
+
+static inline void imgset(img *d, size_t o, float complex z)
+{
+    unsigned short *a = (unsigned short *) d->a + 2 * o;
+    const float    *f = (const float *) &z;
+
+    switch (d->k)
+    {
+        case IMG_F16: a[0] = ftoh(f[0]); a[1] = ftoh(f[1]); return;
+        case IMG_B16: a[0] = ftob(f[0]); a[1] = ftob(f[1]); return;
+        case IMG_R32: ((float *) d->a)[o] = f[0];             return;
+    }
+    ((float complex *) d->a)[o] = z;
 }
 
 static inline void imgget(img *d, int r, int c,
                                   int i, int j, float complex *z, int s)
 {
-    float complex *t = imgbuf(d, r, c, i, j);
+    const size_t o = imgbo(d, r, c, i, j);
 
     if (d->p > 1)
     {
-        z[s + s] = t[2];
-        z[s    ] = t[1];
+        z[s + s] = imgval(d, imgco(d, o, 2));
+        z[s    ] = imgval(d, imgco(d, o, 1));
     }
-    z[0] = t[0];
+    z[0] = imgval(d, o);
 }
 
 static inline void imgput(img *d, int r, int c,
                                   int i, int j, float complex *z, int s)
 {
-    float complex *t = imgbuf(d, r, c, i, j);
+    const size_t o = imgbo(d, r, c, i, j);
 
     if (d->p > 1)
     {
-        t[2] = z[s + s];
-        t[1] = z[s    ];
+        imgset(d, imgco(d, o, 2), z[s + s]);
+        imgset(d, imgco(d, o, 1), z[s    ]);
     }
-    t[0] = z[0];
+    imgset(d, o, z[0]);
 }
 
 //------------------------------------------------------------------------------
@@ -42,11 +42,11 @@ static float gauss(float dd, float rr)
 
 static inline float dd(img *d, int r, int c, int i, int j)
 {
-    const int n = 1 << (d->n - 1);
-    const int m = 1 << (d->m - 1);
+    const int Y = r * d->s + i;
+    const int X = c * d->s + j;
 
-    const int y = (((r * d->s + i) ^ n) - n);
-    const int x = (((c * d->s + j) ^ m) - m);
+    const int y = (Y < (d->n + 1) / 2) ? Y : Y - d->n;
+    const int x = (X < (d->m + 1) / 2) ? X : X - d->m;
 
     return y * y + x * x;
 }
@@ -63,6 +63,9 @@ static void calc(img *d, float rr, int op)
 
     #pragma omp parallel for private(c, i, j, k, t) reduction(+:T)
     for             (r = 0; r < d->h; r++)
+    {
+        imgfetch(d, r + 1, 0, 1, d->w);
+
         for         (c = 0; c < d->w; c++)
             for     (i = 0; i < d->s; i++)
                 for (j = 0; j < d->s; j++)
@@ -76,16 +79,24 @@ static void calc(img *d, float rr, int op)
                     T += t;
 
                     for (k = 0; k < d->p; ++k)
-                        imgbuf(d, r, c, i, j)[k] = t;
+                        imgset(d, imgco(d, imgbo(d, r, c, i, j), k), t);
                 }
+    }
 
     #pragma omp parallel for private(c, i, j, k)
     for                 (r = 0; r < d->h; r++)
+    {
+        imgfetch(d, r + 1, 0, 1, d->w);
+
         for             (c = 0; c < d->w; c++)
             for         (i = 0; i < d->s; i++)
                 for     (j = 0; j < d->s; j++)
                     for (k = 0; k < d->p; k++)
-                        imgbuf(d, r, c, i, j)[k] /= T;
+                    {
+                        const size_t o = imgco(d, imgbo(d, r, c, i, j), k);
+                        imgset(d, o, imgval(d, o) / T);
+                    }
+    }
 }
 
 static bool proc(const char *dst, int l, int n, int m, int p, float r, int op)
@@ -97,6 +108,7 @@ static bool proc(const char *dst, int l, int n, int m, int p, float r, int op)
     {
         if ((d = imgopen(dst, l, n, m, p)))
         {
+            imghint(d, IMG_SEQUENTIAL);
             calc(d, r * r, op);
             imgclose(d);
             ok = true;
@@ -124,7 +136,7 @@ int main(int argc, char **argv)
     bool  t  = false;
     bool  ok = false;
     int   op = 0;
-    int   l  = 5;
+    int   l  = -1;
     int   n  = 0;
     int   m  = 0;
     int   p  = 0;
@@ -137,8 +149,8 @@ int main(int argc, char **argv)
         switch (o)
         {
             case 'l': l = (int) strtol(optarg, 0, 0); break;
-            case 'n': n = (int) strtol(optarg, 0, 0); break;
-            case 'm': m = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = (int) strtol(optarg, 0, 0); break;
             case 'r': r =       strtof(optarg, 0);    break;
 
@@ -23,93 +23,90 @@
 
 //------------------------------------------------------------------------------
 
-static float op_sum(img *s, int k)
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+static inline int omp_get_thread_num()  { return 0; }
+#endif
+
+// Build the index of per-tile statistics with one sweep over all tiles, for
+// all channels at once. Closing the image then records the index, so that
+// later queries need not sweep again.
+
+static bool build(img *s)
 {
-    int   r;
-    int   c;
-    int   i;
-    int   j;
-    float v = 0.0f;
-
-   #pragma omp parallel for private(c, i, j, k) reduction(+:v)
-    for             (r = 0; r < s->h; r++)
-        for         (c = 0; c < s->w; c++)
-            for     (i = 0; i < s->s; i++)
-                for (j = 0; j < s->s; j++)
-                    v += cabs(imgbuf(s, r, c, i, j)[k]);
-    return v;
-}
+    const size_t n = (size_t) s->t;
 
-static float op_cmin(img *s, int k)
-{
-    int   r;
-    int   c;
-    int   i;
-    int   j;
-    float v = FLT_MAX;
-
-//  #pragma omp parallel for private(c, i, j, k) reduction(min:v)
-    for             (r = 0; r < s->h; r++)
-        for         (c = 0; c < s->w; c++)
-            for     (i = 0; i < s->s; i++)
-                for (j = 0; j < s->s; j++)
-                    if (v > cabs(imgbuf(s, r, c, i, j)[k]))
-                        v = cabs(imgbuf(s, r, c, i, j)[k]);
-    return v;
-}
+    float complex *a;
 
-static float op_cmax(img *s, int k)
-{
-    int   r;
-    int   c;
-    int   i;
-    int   j;
-    float v = -FLT_MAX;
-
-//  #pragma omp parallel for private(c, i, j, k) reduction(min:v)
-    for             (r = 0; r < s->h; r++)
-        for         (c = 0; c < s->w; c++)
-            for     (i = 0; i < s->s; i++)
-                for (j = 0; j < s->s; j++)
-                    if (v < cabs(imgbuf(s, r, c, i, j)[k]))
-                        v = cabs(imgbuf(s, r, c, i, j)[k]);
-    return v;
+    int r;
+    int c;
+
+    if (!(a = (float complex *) malloc(sizeof (float complex) * n
+                                             * omp_get_max_threads())))
+    {
+        syserr("Failed to allocate tile buffers");
+        return false;
+    }
+
+    #pragma omp parallel for private(c)
+    for     (r = 0; r < s->h; r++)
+    {
+        imgfetch(s, r + 1, 0, 1, s->w);
+
+        for (c = 0; c < s->w; c++)
+            imgtally(s, r, c, imgwiden(s, r, c, a + n * omp_get_thread_num()));
+    }
+
+    free(a);
+    return true;
 }
 
-static float op_rmin(img *s, int k)
+// Answer a query on channel k from the index.
+
+static double query(img *s, int k, int op)
 {
-    int   r;
-    int   c;
-    int   i;
-    int   j;
-    float v = FLT_MAX;
-
-//  #pragma omp parallel for private(c, i, j, k) reduction(min:v)
-    for             (r = 0; r < s->h; r++)
-        for         (c = 0; c < s->w; c++)
-            for     (i = 0; i < s->s; i++)
-                for (j = 0; j < s->s; j++)
-                    if (v > creal(imgbuf(s, r, c, i, j)[k]))
-                        v = creal(imgbuf(s, r, c, i, j)[k]);
+    double v = 0.0;
+
+    switch (op)
+    {
+        case 'x': v =  FLT_MAX; break;
+        case 'X': v = -FLT_MAX; break;
+        case '0': v =  FLT_MAX; break;
+        case '1': v = -FLT_MAX; break;
+    }
+
+    for     (int r = 0; r < s->h; r++)
+        for (int c = 0; c < s->w; c++)
+        {
+            const struct imgstat *t = imgstats(s, r, c) + k;
+
+            switch (op)
+            {
+                case 's': v +=      t->sum;  break;
+                case 'x': v  = fmin(v, t->min); break;
+                case 'X': v  = fmax(v, t->max); break;
+                case '0': v  = fmin(v, t->lo);  break;
+                case '1': v  = fmax(v, t->hi);  break;
+            }
+        }
     return v;
 }
 
-static float op_rmax(img *s, int k)
+// Print the parameters of an image, its storage, and the domain of its samples.
+
+static void info(img *s)
 {
-    int   r;
-    int   c;
-    int   i;
-    int   j;
-    float v = -FLT_MAX;
-
-//  #pragma omp parallel for private(c, i, j, k) reduction(min:v)
-    for             (r = 0; r < s->h; r++)
-        for         (c = 0; c < s->w; c++)
-            for     (i = 0; i < s->s; i++)
-                for (j = 0; j < s->s; j++)
-                    if (v < creal(imgbuf(s, r, c, i, j)[k]))
-                        v = creal(imgbuf(s, r, c, i, j)[k]);
-    return v;
+    const char *fmt[] = { "c32", "f16", "bf16", "r32" };
+    const char *dom[] = { "spatial", "rows", "columns", "frequency" };
+    const bool  P     = (imglayout(s) == IMG_PLANAR);
+
+    printf("l=%d n=%d m=%d p=%d format=%s%s%s%s domain=%s index=%s\n",
+           s->l, s->n, s->m, s->p, fmt[s->k], P        ? "+planar"  : "",
+                                              s->z     ? "+zlib"    : "",
+                                              s->v     ? "+striped" : "",
+           dom[s->e & 3], imgindexed(s) ? "current" : "stale");
 }
 
 static bool proc(const char *dst, int l, int n, int m, int p, int op)
@@ -122,23 +119,25 @@ static bool proc(const char *dst, int l, int n, int m, int p, int op)
     {
         if ((s = imgopen(dst, l, n, m, p)))
         {
-            for (k = 0; k < s->p; k++)
+            if (imgindexed(s) || op == 'i')
+                ok = true;
+            else if (s->x)
             {
-                float v = 0.0f;
-
-                switch (op)
-                {
-                    case 's': v = op_sum(s, k); break;
-                    case 'x': v = op_cmin(s, k); break;
-                    case 'X': v = op_cmax(s, k); break;
-                    case '0': v = op_rmin(s, k); break;
-                    case '1': v = op_rmax(s, k); break;
-                }
-
-                printf("%e\n", v);
+                imghint(s, IMG_SEQUENTIAL);
+                ok = build(s);
             }
+            else apperr("Failed to allocate index");
+
+            imgkeep(s);
+
+            if (ok && op == 'i')
+                info(s);
+
+            else if (ok)
+                for (k = 0; k < s->p; k++)
+                    printf("%e\n", query(s, k, op));
+
             imgclose(s);
-            ok = true;
         }
     }
     else apperr("Failed to guess image parameters");
@@ -154,9 +153,12 @@ static int usage(const char *exe)
                                "[-n height] "
                                "[-m width] "
                                "[-p samples] op src\n"
-                     "\tsum:  -s\n"
-                     "\tmin:  -x\n"
-                     "\tmax:  -X\n", exe);
+                     "\t     sum:  -s\n"
+                     "\t     min:  -x\n"
+                     "\t     max:  -X\n"
+                     "\treal min:  -0\n"
+                     "\treal max:  -1\n"
+                     "\t    info:  -i\n", exe);
     return EXIT_FAILURE;
 }
 
@@ -165,7 +167,7 @@ int main(int argc, char **argv)
     bool ok = false;
     bool T  = false;
     int  op = 0;
-    int  l  = 0;
+    int  l  = -1;
     int  n  = 0;
     int  m  = 0;
     int  p  = 0;
@@ -173,12 +175,12 @@ int main(int argc, char **argv)
 
     // Parse the command line options.
 
-    while ((o = getopt(argc, argv, "l:n:m:p:01sxXt")) != -1)
+    while ((o = getopt(argc, argv, "l:n:m:p:01sxXit")) != -1)
         switch (o)
         {
             case 'l': l = (int) strtol(optarg, 0, 0); break;
-            case 'n': n = (int) strtol(optarg, 0, 0); break;
-            case 'm': m = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = (int) strtol(optarg, 0, 0); break;
 
             case 's': op = o; break;
@@ -186,6 +188,7 @@ int main(int argc, char **argv)
             case 'X': op = o; break;
             case '0': op = o; break;
             case '1': op = o; break;
+            case 'i': op = o; break;
 
             case 't': T = true; break;
 
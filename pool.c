@@ -0,0 +1,495 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "err.h"
+#include "pool.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+#endif
+
+//------------------------------------------------------------------------------
+
+// The pool is backed by an anonymous memory file mapped twice. The view is the
+// range given to the caller, and its protection tracks the state of each frame:
+// no access if not resident or not recently used, read-only if clean, and read-
+// write if dirty. Touching the view thus raises a fault, and the handler does
+// the paging through the second mapping, which is always writable. Frames not
+// resident have their memory released to the system.
+//
+// The handler holds the pool lock only to choose a slot. A frame being paged
+// in or out is marked busy, and the transfer proceeds without the lock, so
+// that threads faulting on different frames read, write, and decode them in
+// parallel. A thread faulting on a busy frame waits for it to settle.
+
+enum
+{
+    RES   = 1,  // resident
+    DIRTY = 2,  // written since loaded or synced
+    REF   = 4,  // referenced since the clock hand passed
+    READ  = 8,  // view readable
+    WRITE = 16, // view writable
+    BUSY  = 32, // being paged in or out
+};
+
+struct pool
+{
+    int     f;     // image file descriptor
+    off_t   o;     // file offset of the pooled range
+    size_t  len;   // length of the pooled range
+    size_t  F;     // frame size
+    size_t  K;     // frame count
+    size_t  S;     // slot count
+    size_t  hand;  // clock hand
+    char   *view;  // mapping seen by the caller
+    char   *back;  // mapping used for I/O
+    int     mem;   // memory file descriptor
+    long   *slot;  // frame held by each slot, or -1
+    long   *list;  // frames to be written back by sync
+    poolfn  fn;    // frame transfer function, or null for pread and pwrite
+    void   *fp;    // frame transfer function argument
+    unsigned char *st; // state of each frame
+};
+
+#define POOLS 16
+
+static struct pool     *pools[POOLS];
+static struct sigaction old;
+static volatile int     busy;
+
+static void lock(void)
+{
+    while (__sync_lock_test_and_set(&busy, 1))
+        sched_yield();
+}
+
+static void unlock(void)
+{
+    __sync_lock_release(&busy);
+}
+
+//------------------------------------------------------------------------------
+
+// Give the byte length of frame k, which is short at the end of the range.
+
+static size_t length(const struct pool *q, size_t k)
+{
+    const size_t a = q->F * k;
+
+    return (q->len - a < q->F) ? q->len - a : q->F;
+}
+
+// Transfer frame k between the file and the back mapping. A transfer function
+// moves whole frames, as it may encode them.
+
+static bool xfer(const struct pool *q, size_t k, bool out)
+{
+    char  *buf = q->back + q->F * k;
+    size_t len = length(q, k);
+    off_t  o   = q->o    + q->F * k;
+
+    if (q->fn)
+        return q->fn(q->fp, k, buf, q->F, out);
+
+    while (len > 0)
+    {
+        ssize_t n = out ? pwrite(q->f, buf, len, o)
+                        : pread (q->f, buf, len, o);
+        if (n > 0)
+        {
+            buf += n;
+            len -= n;
+            o   += n;
+        }
+        else return false;
+    }
+    return true;
+}
+
+// Set the view protection of frame k to match its state.
+
+static void protect(struct pool *q, size_t k)
+{
+    int prot = PROT_NONE;
+
+    if (q->st[k] & READ)  prot |= PROT_READ;
+    if (q->st[k] & WRITE) prot |= PROT_WRITE;
+
+    mprotect(q->view + q->F * k, q->F, prot);
+}
+
+// Revoke all access to frame k and mark it busy, so that no reader sees its
+// memory released and no other thread pages it, until it is evicted.
+
+static void seize(struct pool *q, size_t k)
+{
+    q->st[k] = BUSY | (q->st[k] & DIRTY);
+    protect(q, k);
+}
+
+// Write frame k back to the file if dirty, and release its memory. This needs
+// no lock, as the frame is busy.
+
+static bool evict(struct pool *q, size_t k)
+{
+    bool ok = (q->st[k] & DIRTY) ? xfer(q, k, true) : true;
+
+    madvise(q->back + q->F * k, q->F, MADV_REMOVE);
+
+    return ok;
+}
+
+// Advance the clock hand to a slot that is free or that may be freed, giving a
+// second chance to each frame referenced since the last pass. Clearing the
+// reference also revokes access, so that the next touch will be seen. A frame
+// to be evicted from the slot is revoked and returned in e, else e is -1.
+
+static size_t victim(struct pool *q, long *e)
+{
+    for (;;)
+    {
+        const size_t i = q->hand;
+        const long   k = q->slot[i];
+
+        q->hand = (q->hand + 1) % q->S;
+        *e      = -1;
+
+        if (k < 0)
+            return i;
+
+        if (q->st[k] & BUSY)
+            continue;
+
+        if (q->st[k] & REF)
+        {
+            q->st[k] &= ~(REF | READ | WRITE);
+            protect(q, k);
+        }
+        else
+        {
+            seize(q, k);
+            *e = k;
+            return i;
+        }
+    }
+}
+
+// Bring frame k into the view for reading or writing, given the lock, and give
+// up the lock. Another thread may have done so already, in which case the
+// access need only be retried, or may be doing so, in which case the access is
+// retried once it has had time to finish.
+
+static void touch(struct pool *q, size_t k, bool w)
+{
+    const unsigned char s = q->st[k];
+
+    if (s & BUSY)
+    {
+        unlock();
+        sched_yield();
+        return;
+    }
+    if (!(s & RES))
+    {
+        long         e;
+        const size_t i = victim(q, &e);
+
+        q->slot[i] = (long) k;
+        q->st[k]   = BUSY;
+
+        unlock();
+        {
+            if (e >= 0 && !evict(q, e))
+            {
+                syserr("Failed to write image tile");
+                _exit(EXIT_FAILURE);
+            }
+            if (!xfer(q, k, false))
+            {
+                syserr("Failed to read image tile");
+                _exit(EXIT_FAILURE);
+            }
+        }
+        lock();
+
+        if (e >= 0)
+            q->st[e] = 0;
+
+        q->st[k] = RES;
+    }
+    else if ((s & WRITE) || ((s & READ) && !w))
+    {
+        unlock();
+        return;
+    }
+
+    q->st[k] |= REF | READ;
+
+    if (w || (q->st[k] & DIRTY))
+        q->st[k] |= WRITE | DIRTY;
+
+    protect(q, k);
+    unlock();
+}
+
+// Handle a fault in the view of any pool. Anything else is a true segmentation
+// fault, so restore the prior handler and let the access fault again.
+
+static void fault(int sig, siginfo_t *info, void *ctx)
+{
+    const int e = errno;
+    char     *a = (char *) info->si_addr;
+    bool      w = true;
+    bool     ok = false;
+
+#if defined(__x86_64__) && defined(REG_ERR)
+    w = (((ucontext_t *) ctx)->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+#endif
+
+    lock();
+    {
+        for (int i = 0; i < POOLS && !ok; i++)
+            if (pools[i] && pools[i]->view <= a
+                         && a < pools[i]->view + pools[i]->F * pools[i]->K)
+            {
+                touch(pools[i], (a - pools[i]->view) / pools[i]->F, w);
+                ok = true;
+            }
+    }
+    if (!ok)
+    {
+        unlock();
+        sigaction(SIGSEGV, &old, NULL);
+    }
+    errno = e;
+}
+
+//------------------------------------------------------------------------------
+
+// Register a pool, installing the fault handler with the first.
+
+static bool enlist(struct pool *q)
+{
+    static bool handled = false;
+
+    bool ok = false;
+
+    lock();
+    {
+        for (int i = 0; i < POOLS && !ok; i++)
+            if (pools[i] == NULL)
+            {
+                pools[i] = q;
+                ok = true;
+            }
+
+        if (ok && !handled)
+        {
+            struct sigaction sa;
+
+            memset(&sa, 0, sizeof (sa));
+            sa.sa_sigaction = fault;
+            sa.sa_flags     = SA_SIGINFO;
+            sigemptyset(&sa.sa_mask);
+
+            handled = (sigaction(SIGSEGV, &sa, &old) == 0);
+            ok      = handled;
+        }
+    }
+    unlock();
+
+    return ok;
+}
+
+static void delist(struct pool *q)
+{
+    lock();
+    {
+        for (int i = 0; i < POOLS; i++)
+            if (pools[i] == q)
+                pools[i] = NULL;
+    }
+    unlock();
+}
+
+//------------------------------------------------------------------------------
+
+// Open a pool of frames of at least the given size, rounded to whole pages, on
+// the given range of file f, holding no more than cap bytes. Every thread may
+// need a frame or two at once, so refuse a cap too small for that. Given a
+// transfer function fn, use it to move frames rather than pread and pwrite.
+
+struct pool *poolopen(int f, off_t o, size_t len, size_t frame, size_t cap,
+                                                  poolfn fn, void *fp)
+{
+    const size_t P = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t F = frame ? (frame + P - 1) / P * P : P;
+    const size_t K = (len   + F - 1) / F;
+    const size_t S = cap / F;
+    const size_t T = 4 * (size_t) omp_get_max_threads();
+
+    struct pool *q;
+
+    if (S < T && S < K)
+    {
+        apperr("Buffer pool needs at least %zu bytes", T * F);
+        return NULL;
+    }
+    if ((q = (struct pool *) calloc(1, sizeof (struct pool))))
+    {
+        q->f    = f;
+        q->o    = o;
+        q->len  = len;
+        q->F    = F;
+        q->K    = K;
+        q->S    = S < K ? S : K;
+        q->fn   = fn;
+        q->fp   = fp;
+        q->view = MAP_FAILED;
+        q->back = MAP_FAILED;
+
+        if ((q->slot = (long *)          malloc(q->S * sizeof (long))) &&
+            (q->list = (long *)          malloc(q->S * sizeof (long))) &&
+            (q->st   = (unsigned char *) calloc(q->K, 1)) &&
+            (q->mem  = memfd_create("gigo-pool", 0)) != -1 &&
+            ftruncate(q->mem, F * K) == 0 &&
+            (q->view = mmap(0, F * K, PROT_NONE, MAP_SHARED, q->mem, 0)) != MAP_FAILED &&
+            (q->back = mmap(0, F * K, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED, q->mem, 0)) != MAP_FAILED)
+        {
+            for (size_t i = 0; i < q->S; i++)
+                q->slot[i] = -1;
+
+            if (enlist(q))
+                return q;
+
+            apperr("Failed to register buffer pool");
+        }
+        else syserr("Failed to create buffer pool");
+
+        if (q->back != MAP_FAILED) munmap(q->back, F * K);
+        if (q->view != MAP_FAILED) munmap(q->view, F * K);
+        if (q->mem > 0) close(q->mem);
+
+        free(q->st);
+        free(q->list);
+        free(q->slot);
+        free(q);
+    }
+    return NULL;
+}
+
+void *poolptr(struct pool *q)
+{
+    return q->view;
+}
+
+// Write back all dirty frames overlapping bytes a through b of the range. The
+// caller must not touch the view meanwhile. Revoke write access first so that
+// no store can slip in after the write, then write the frames in parallel, as
+// each may need encoding.
+
+bool poolsync(struct pool *q, size_t a, size_t b)
+{
+    long n = 0;
+    long e = 0;
+    long j;
+
+    lock();
+    {
+        for (size_t i = 0; i < q->S; i++)
+        {
+            const long k = q->slot[i];
+
+            if (k >= 0 && a < q->F * (k + 1) && q->F * k < b
+                       && (q->st[k] & DIRTY))
+            {
+                if (q->st[k] & WRITE)
+                {
+                    q->st[k] &= ~WRITE;
+                    protect(q, k);
+                }
+                q->list[n++] = k;
+            }
+        }
+    }
+    unlock();
+
+    #pragma omp parallel for reduction(+:e)
+    for (j = 0; j < n; j++)
+        if (xfer(q, q->list[j], true))
+            q->st[q->list[j]] &= ~DIRTY;
+        else
+            e++;
+
+    if (e) syserr("Failed to write image tiles");
+
+    return (e == 0);
+}
+
+// Discard all frames overlapping bytes a through b of the range, as the file
+// has been written there behind the pool's back.
+
+void pooldrop(struct pool *q, size_t a, size_t b)
+{
+    lock();
+    {
+        for (size_t i = 0; i < q->S; i++)
+        {
+            const long k = q->slot[i];
+
+            if (k >= 0 && a < q->F * (k + 1) && q->F * k < b)
+            {
+                q->st[k] = BUSY;
+                protect(q, k);
+                evict(q, k);
+                q->st[k] = 0;
+                q->slot[i] = -1;
+            }
+        }
+    }
+    unlock();
+}
+
+// Write back all dirty frames and release the pool.
+
+bool poolclose(struct pool *q)
+{
+    const bool ok = poolsync(q, 0, q->len);
+
+    delist(q);
+
+    munmap(q->back, q->F * q->K);
+    munmap(q->view, q->F * q->K);
+    close(q->mem);
+
+    free(q->st);
+    free(q->list);
+    free(q->slot);
+    free(q);
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,44 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_POOL_H
+#define GIGO_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+//------------------------------------------------------------------------------
+
+// A buffer pool presents len bytes of file f, beginning at offset o, as one
+// contiguous range of memory, as would a mapping. Only a fixed number of
+// frames of the file are resident at once, read with pread on first touch,
+// written back with pwrite only if stored to, and evicted in CLOCK order. The
+// pool thus holds no more than cap bytes of memory however the image is used.
+// Block transfers that bypass the pool must sync it before reading the file
+// and drop it after writing, so that neither sees stale data. A transfer
+// function may take the place of pread and pwrite, moving frame k whole.
+
+struct pool;
+
+typedef bool (*poolfn)(void *p, size_t k, void *buf, size_t len, bool out);
+
+struct pool *poolopen(int f, off_t o, size_t len, size_t frame, size_t cap,
+                                                  poolfn fn, void *fp);
+void        *poolptr (struct pool *q);
+bool         poolsync(struct pool *q, size_t a, size_t b);
+void         pooldrop(struct pool *q, size_t a, size_t b);
+bool         poolclose(struct pool *q);
+
+//------------------------------------------------------------------------------
+
+#endif
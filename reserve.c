@@ -17,12 +17,15 @@
 #include "img.h"
 #include "err.h"
 #include "etc.h"
+#include "zip.h"
 
 //------------------------------------------------------------------------------
 
 static int usage(const char *exe)
 {
-    fprintf(stderr, "Usage:\t%s [-t1] "
+    fprintf(stderr, "Usage:\t%s [-t1zP] "
+                               "[-f format] "
+                               "[-s dirs] "
                                "[-l size] "
                                "[-n height] "
                                "[-m width] "
@@ -36,24 +39,35 @@ int main(int argc, char **argv)
 
     bool ok = false;
     bool t  = false;
-    int  l  = 5;
+    int  l  = -1;
     int  n  = 0;
     int  m  = 0;
     int  p  = 0;
+    int  k  = IMG_C32;
+    int  z  = ZIP_NONE;
+    int  y  = IMG_INTERLEAVED;
     int  o;
 
+    const char *s = NULL;
+
     // Parse the command line options.
 
-    while ((o = getopt(argc, argv, "t1l:n:m:p:")) != -1)
+    while ((o = getopt(argc, argv, "t1zPf:s:l:n:m:p:")) != -1)
         switch (o)
         {
+            case 'f': if ((k = imgfmt(optarg)) < 0)
+                          return usage(argv[0]);
+                      break;
+            case 's': s = optarg; break;
             case 'l': l = (int) strtol(optarg, 0, 0); break;
-            case 'n': n = (int) strtol(optarg, 0, 0); break;
-            case 'm': m = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = (int) strtol(optarg, 0, 0); break;
 
             case 't': t = true; break;
             case '1': v = 1.f;  break;
+            case 'z': z = ZIP_ZLIB; break;
+            case 'P': y = IMG_PLANAR; break;
             case '?':
             default : return usage(argv[0]);
         }
@@ -69,7 +83,7 @@ int main(int argc, char **argv)
     {
         if (optind + 1 == argc)
         {
-             ok = imginit(argv[optind], l, n, m, p, v);
+             ok = imginit(argv[optind], l, n, m, p, k, z, y, s, v);
         }
         else return usage(argv[0]);
     }
@@ -0,0 +1,118 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "img.h"
+#include "err.h"
+#include "etc.h"
+
+//------------------------------------------------------------------------------
+
+static bool proc(const char *src,  // source image file name
+                 const char *dst,  // destination image file name, or null
+                 const char *s,    // destination stripe directories, or null
+                         int l,    // source log2 tile size
+                         int n,    // image height
+                         int m,    // image width
+                         int p,    // pixel size
+                         int L)    // destination log2 tile size
+{
+    bool ok = false;
+
+    if (dst == NULL && s)
+        apperr("Striping applies to a new image only");
+
+    else if (dst && strcmp(dst, src) == 0)
+        apperr("Output image %s is the input image", dst);
+
+    else if ((n && m && p) || imgargs(src, &n, &m, &p))
+        ok = imgretile(src, l, n, m, p, L, dst, s);
+
+    else apperr("Failed to guess '%s' image parameters", src);
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+static int usage(const char *exe)
+{
+    fprintf(stderr, "Usage:\t%s [-t] "
+                               "[-s dirs] "
+                               "[-L size] "
+                               "[-l size] "
+                               "[-n height] "
+                               "[-m width] "
+                               "[-p samples] image [output]\n", exe);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = false;
+    bool t  = false;
+    int  L  = -1;
+    int  l  = -1;
+    int  n  = 0;
+    int  m  = 0;
+    int  p  = 0;
+    int  o;
+
+    const char *s = NULL;
+
+    // Parse the command line options.
+
+    while ((o = getopt(argc, argv, "s:L:l:n:m:p:t")) != -1)
+        switch (o)
+        {
+            case 's': s = optarg; break;
+            case 'L': L = (int) strtol(optarg, 0, 0); break;
+            case 'l': l = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
+            case 'p': p = (int) strtol(optarg, 0, 0); break;
+
+            case 't': t = true; break;
+            case '?':
+            default : return usage(argv[0]);
+        }
+
+    // Confirm the arguments and run the process.
+
+    setexe(argv[0]);
+
+    struct timeval t0;
+    struct timeval t1;
+
+    gettimeofday(&t0, 0);
+    {
+        if (optind + 1 == argc)
+        {
+            ok = proc(argv[optind], NULL, s, l, n, m, p, L);
+        }
+        else if (optind + 2 == argc)
+        {
+            ok = proc(argv[optind], argv[optind + 1], s, l, n, m, p, L);
+        }
+        else return usage(argv[0]);
+    }
+    gettimeofday(&t1, 0);
+
+    if (t) printtime(&t0, &t1);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,240 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "err.h"
+#include "stripe.h"
+
+//------------------------------------------------------------------------------
+
+struct stripe
+{
+    int     N;   // file count
+    size_t  R;   // row size
+    size_t  len; // length of the samples
+    int    *f;   // file descriptors
+};
+
+// Give the length of file i of a set, which holds every Nth row from row i.
+
+static size_t length(const struct stripe *s, int i)
+{
+    const size_t H = s->len / s->R;
+
+    return s->R * ((H + s->N - 1 - i) / s->N);
+}
+
+static bool xfer(int f, char *buf, size_t len, off_t o, bool out)
+{
+    while (len > 0)
+    {
+        ssize_t n = out ? pwrite(f, buf, len, o)
+                        : pread (f, buf, len, o);
+        if (n > 0)
+        {
+            buf += n;
+            len -= n;
+            o   += n;
+        }
+        else return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Open the N files of a set, checking that each has the length its rows need,
+// or create them at that length, sparse or allocated on disk.
+
+struct stripe *stripeopen(const char *list, int N, size_t R, size_t len,
+                                                           int how)
+{
+    struct stripe *s;
+    struct stat    b;
+
+    if ((s = (struct stripe *) calloc(1, sizeof (struct stripe))))
+    {
+        if ((s->f = (int *) malloc(N * sizeof (int))))
+        {
+            int i;
+
+            s->N   = N;
+            s->R   = R;
+            s->len = len;
+
+            for (i = 0; i < N; i++, list += strlen(list) + 1)
+            {
+                const size_t n = length(s, i);
+
+                if ((s->f[i] = open(list, how ? O_CREAT | O_TRUNC | O_RDWR
+                                              : O_RDWR, 0644)) == -1)
+                {
+                    syserr("Failed to open stripe %s", list);
+                    break;
+                }
+                if (how)
+                {
+                    if (ftruncate(s->f[i], n) == -1)
+                    {
+                        syserr("Failed to size stripe %s", list);
+                        break;
+                    }
+                    if (how == STRIPE_ALLOCATE && n &&
+                       (errno = posix_fallocate(s->f[i], 0, (off_t) n)))
+                    {
+                        syserr("Failed to allocate stripe %s", list);
+                        break;
+                    }
+                }
+                else if (fstat(s->f[i], &b) == -1 || (size_t) b.st_size != n)
+                {
+                    apperr("Size of stripe %s does not match image", list);
+                    break;
+                }
+            }
+            if (i == N)
+                return s;
+
+            for (; i >= 0; i--)
+                if (s->f[i] != -1)
+                    close(s->f[i]);
+
+            free(s->f);
+        }
+        free(s);
+    }
+    return NULL;
+}
+
+// Map the samples of a set into one range of memory, one row at a time, each
+// from its place in its file.
+
+void *stripemap(struct stripe *s)
+{
+    const size_t H = s->len / s->R;
+
+    char *a;
+
+    if ((a = mmap(0, s->len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS
+                                                    | MAP_NORESERVE, -1, 0))
+                                                    == MAP_FAILED)
+        return NULL;
+
+    for (size_t r = 0; r < H; r++)
+        if (mmap(a + s->R * r, s->R, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, s->f[r % s->N],
+                 (off_t) (s->R * (r / s->N))) == MAP_FAILED)
+        {
+            munmap(a, s->len);
+            return NULL;
+        }
+
+    return a;
+}
+
+// Locate byte a of the samples of a set, giving the file holding it and its
+// offset there, and return the length of the rest of its row.
+
+size_t stripefind(const struct stripe *s, size_t a, int *f, off_t *o)
+{
+    const size_t r = a / s->R;
+    const size_t j = a % s->R;
+
+    *f = s->f[r % s->N];
+    *o = (off_t) (s->R * (r / s->N) + j);
+
+    return s->R - j;
+}
+
+// Transfer len bytes between buffer and the samples of a set, beginning at byte
+// a, one piece of one row at a time.
+
+bool stripexfer(struct stripe *s, void *buf, size_t len, size_t a, bool out)
+{
+    char *b = (char *) buf;
+
+    while (len > 0)
+    {
+        int          f;
+        off_t        o;
+        const size_t n = stripefind(s, a, &f, &o);
+        const size_t c = (len < n) ? len : n;
+
+        if (!xfer(f, b, c, o, out))
+            return false;
+
+        a   += c;
+        b   += c;
+        len -= c;
+    }
+    return true;
+}
+
+// Transfer frame k of len bytes between buffer and set, as a pool transfer
+// function. The last frame may run past the end of the samples.
+
+bool stripeio(void *p, size_t k, void *buf, size_t len, bool out)
+{
+    struct stripe *s = (struct stripe *) p;
+
+    const size_t a = len * k;
+    const size_t n = (len < s->len - a) ? len : s->len - a;
+
+    return stripexfer(s, buf, n, a, out);
+}
+
+// Begin reading bytes a through b of the samples into the page cache.
+
+void stripefetch(struct stripe *s, size_t a, size_t b)
+{
+    while (a < b && a < s->len)
+    {
+        int          f;
+        off_t        o;
+        const size_t n = stripefind(s, a, &f, &o);
+        const size_t c = (b - a < n) ? b - a : n;
+
+        posix_fadvise(f, o, (off_t) c, POSIX_FADV_WILLNEED);
+        a += c;
+    }
+}
+
+// Declare the pattern of the coming accesses to every file of the set.
+
+void stripehint(struct stripe *s, int advice)
+{
+    for (int i = 0; i < s->N; i++)
+        posix_fadvise(s->f[i], 0, 0, advice);
+}
+
+// Release the set. Any mapping of it is released separately.
+
+void stripeclose(struct stripe *s)
+{
+    for (int i = 0; i < s->N; i++)
+        close(s->f[i]);
+
+    free(s->f);
+    free(s);
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,52 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_STRIPE_H
+#define GIGO_STRIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+//------------------------------------------------------------------------------
+
+// A striped image cache keeps its samples in N files, usually on as many disks,
+// so that a sweep draws upon the bandwidth of all of them at once. Rows of tiles
+// of R bytes are dealt among the files round-robin, row r lying in file r % N
+// at offset R * (r / N). The set presents the len bytes of samples as a single
+// range, either mapped piecewise into contiguous memory or paged through a
+// buffer pool, with stripeio as its transfer function. The files are named by
+// a list of N null-terminated paths, one after another.
+
+enum
+{
+    STRIPE_OPEN,
+    STRIPE_CREATE,
+    STRIPE_ALLOCATE,
+};
+
+struct stripe;
+
+struct stripe *stripeopen (const char *list, int N, size_t R, size_t len,
+                                                            int how);
+void          *stripemap  (struct stripe *s);
+size_t         stripefind (const struct stripe *s, size_t a, int *f, off_t *o);
+bool           stripexfer (struct stripe *s, void *buf, size_t len, size_t a,
+                                                                   bool out);
+bool           stripeio   (void *p, size_t k, void *buf, size_t len, bool out);
+void           stripefetch(struct stripe *s, size_t a, size_t b);
+void           stripehint (struct stripe *s, int advice);
+void           stripeclose(struct stripe *s);
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -20,31 +20,222 @@
 
 //------------------------------------------------------------------------------
 
-static void blit(img *d, int x, int y, img *s, int X, int Y, int W, int H)
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_thread_num()  { return 0; }
+static inline int omp_get_num_threads() { return 1; }
+#endif
+
+// The region moves by explicit I/O through the queue of each thread rather
+// than by faulting the mappings. It is cut into jobs of one row of up to CHUNK
+// bytes of destination tiles, each given the block of source tiles that covers
+// it. Each thread works a contiguous run of jobs, going round a ring of Q pairs
+// of buffers, each with an I/O group of its own, reading one job ahead while
+// one is copied, and writing the last behind. Destination tiles are read before
+// being written, as the region may cover them only in part.
+
+#define CHUNK (2 << 20)
+#define Q     3
+
+struct job
+{
+    int r, c, h, w; // block of destination tiles
+    int R, C, H, W; // block of source tiles
+};
+
+// Give the most source tiles of size 2^L spanned by n destination tiles of size
+// 2^l, which may be one more than their pixels need at either end.
+
+static int cover(int n, int l, int L)
+{
+    return (((n << l) - 1) >> L) + 2;
+}
+
+// Find the blocks of destination and source tiles of job j, given the jobs K
+// per row of destination tiles, each of n tiles.
+
+static void jobget(struct job *b, int j, int K, int n,
+                   img *d, int x, int y, img *s, int X, int Y, int W, int H)
+{
+    const int r0 = (y        ) >> d->l;
+    const int c0 = (x        ) >> d->l;
+    const int c1 = (x + W - 1) >> d->l;
+
+    const int r  = r0 + j / K;
+    const int c  = c0 + j % K * n;
+    const int w  = min(n, c1 - c + 1);
+
+    const int ya = max(y,     (r    ) << d->l), yb = min(y + H, (r + 1) << d->l);
+    const int xa = max(x,     (c    ) << d->l), xb = min(x + W, (c + w) << d->l);
+
+    b->r = r;
+    b->c = c;
+    b->h = 1;
+    b->w = w;
+    b->R = (Y + ya - y) >> s->l;
+    b->C = (X + xa - x) >> s->l;
+    b->H = ((Y + yb - y - 1) >> s->l) - b->R + 1;
+    b->W = ((X + xb - x - 1) >> s->l) - b->C + 1;
+}
+
+// Begin to read, or write, the buffered tiles of job j in buffer pair q.
+
+static bool jobio(struct job *b, img *d, img *s, char *D, char *S, int q,
+                                                             bool out)
+{
+    if (out)
+        return imgpost(d, b->r, b->c, b->h, b->w, D, true,  q + 1);
+    else
+        return imgpost(d, b->r, b->c, b->h, b->w, D, false, q + 1)
+            && imgpost(s, b->R, b->C, b->H, b->W, S, false, q + 1);
+}
+
+// Copy the pixels of job b between its buffered blocks, presented as images e
+// and f of their own, with the first c channels of each pixel.
+
+static void jobcopy(struct job *b, img *d, int x, int y,
+                                   img *s, int X, int Y, int W, int H,
+                                   char *D, char *S)
+{
+    const int c  = (s->p < d->p) ? s->p : d->p;
+    const int ya = max(y,     (b->r    ) << d->l);
+    const int yb = min(y + H, (b->r + 1) << d->l);
+    const int xa = max(x,     (b->c       ) << d->l);
+    const int xb = min(x + W, (b->c + b->w) << d->l);
+
+    img e = *d;
+    img f = *s;
+
+    e.a = D;
+    e.h = b->h;
+    e.w = b->w;
+    f.a = S;
+    f.h = b->H;
+    f.w = b->W;
+
+    for         (int i = ya; i < yb; i++)
+        for     (int j = xa; j < xb; j++)
+            for (int k = 0;  k < c;  k++)
+                imgset(&e, imgco(&e, imgzo(&e, i - (b->r << d->l),
+                                                j - (b->c << d->l)), k),
+                imgval(&f, imgco(&f, imgzo(&f, Y + i - y - (b->R << s->l),
+                                                X + j - x - (b->C << s->l)),
+                                                                       k)));
+}
+
+// Copy a W by H region of image s at (X, Y) to image d at (x, y), clipped to
+// both images.
+
+static bool blit(img *d, int x, int y, img *s, int X, int Y, int W, int H)
 {
-    const int c = (s->p < d->p) ? s->p : d->p;
-    int i;
-    int j;
-    int k;
-
-    #pragma omp parallel for private(j)
-    for         (i = 0; i < H; i++)
-        for     (j = 0; j < W; j++)
-            for (k = 0; k < c; k++)
-                imgz(d, y + i, x + j)[k] = imgz(s, Y + i, X + j)[k];
+    W = min(W, min(d->m - x, s->m - X));
+    H = min(H, min(d->n - y, s->n - Y));
+
+    if (x < 0 || y < 0 || X < 0 || Y < 0 || W <= 0 || H <= 0)
+        return true;
+
+    const size_t t = imgsize(d->k) * d->t;
+    const size_t T = imgsize(s->k) * s->t;
+
+    const int r0 = (y        ) >> d->l;
+    const int r1 = (y + H - 1) >> d->l;
+    const int c0 = (x        ) >> d->l;
+    const int c1 = (x + W - 1) >> d->l;
+    const int h  = min(s->h, cover(1, d->l, s->l));
+
+    // Narrow the jobs until their blocks of source tiles fit a few chunks.
+
+    int n = max(1, min(c1 - c0 + 1, (int) (CHUNK / t)));
+    int w = min(s->w, cover(n, d->l, s->l));
+
+    while (n > 1 && T * h * w > 4 * CHUNK)
+    {
+        n = n / 2;
+        w = min(s->w, cover(n, d->l, s->l));
+    }
+
+    const int    K = (c1 - c0 + n) / n;
+    const int    J = (r1 - r0 + 1) * K;
+    const size_t A = t * n;
+    const size_t B = T * h * w;
+
+    char **a;
+    long   e = 0;
+
+    if (!(a = (char **) imgallocs((A + B) * Q)))
+    {
+        syserr("Failed to allocate tile buffers");
+        return false;
+    }
+
+    #pragma omp parallel reduction(+:e)
+    {
+        const int N = omp_get_num_threads();
+        const int i = omp_get_thread_num();
+        const int j0 = (int) ((long) J *  i      / N);
+        const int j1 = (int) ((long) J * (i + 1) / N);
+
+        char *D = a[i];
+        char *S = a[i] + A * Q;
+
+        struct job b;
+
+        bool ok = true;
+        int  j;
+        int  q;
+
+        if (j0 < j1)
+        {
+            jobget(&b, j0, K, n, d, x, y, s, X, Y, W, H);
+            ok = jobio(&b, d, s, D, S, 0, false);
+        }
+
+        for (j = j0; ok && j < j1; j++)
+        {
+            q = (j - j0) % Q;
+
+            if (!(ok = imgwait(q + 1)))
+                break;
+
+            if (j + 1 < j1)
+            {
+                const int u = (j + 1 - j0) % Q;
+
+                jobget(&b, j + 1, K, n, d, x, y, s, X, Y, W, H);
+
+                if (!(ok = imgwait(u + 1) &&
+                           jobio(&b, d, s, D + A * u, S + B * u, u, false)))
+                    break;
+            }
+
+            jobget (&b, j, K, n, d, x, y, s, X, Y, W, H);
+            jobcopy(&b, d, x, y, s, X, Y, W, H, D + A * q, S + B * q);
+
+            ok = jobio(&b, d, s, D + A * q, S + B * q, q, true);
+        }
+        for (q = 0; q < Q; q++)
+            ok = imgwait(q + 1) && ok;
+
+        if (!ok)
+            e++;
+    }
+
+    imgfrees((void **) a, (A + B) * Q);
+    return (e == 0);
 }
 
 static bool proc(const char *dst,  // destination image file name
                          int l,    // destination log2 tile size
-                         int n,    // destination log2 image height
-                         int m,    // destination log2 image width
+                         int n,    // destination image height
+                         int m,    // destination image width
                          int p,    // destination pixel size
                          int x,    // destination region x
                          int y,    // destination region y
                  const char *src,  // source image file name
                          int L,    // source log2 tile size
-                         int N,    // source log2 image height
-                         int M,    // source log2 image width
+                         int N,    // source image height
+                         int M,    // source image width
                          int P,    // source pixel size
                          int X,    // source region x
                          int Y,    // source region y
@@ -64,15 +255,15 @@ static bool proc(const char *dst,  // destination image file name
             {
                 if ((s = imgopen(src, L, N, M, P)))
                 {
-                    if (H == 0) H = 1 << N;
-                    if (W == 0) W = 1 << M;
+                    if (H == 0) H = N;
+                    if (W == 0) W = M;
 
-                    blit(d, x, y, s, X, Y, W, H);
+                    imgkeep(s);
 
-                    ok = true;
-                    imgclose(d);
+                    ok = blit(d, x, y, s, X, Y, W, H);
+                    imgclose(s);
                 }
-                imgclose(s);
+                imgclose(d);
             }
         }
         else apperr("Failed to guess '%s' image parameters", dst);
@@ -91,14 +282,14 @@ static int usage(const char *exe)
                                "[-L size] [-N height] [-M width] [-P samples] "
                                "-x x -y y -X X -Y Y -W W -H H dst src\n"
                                "\tl ... destination log2 tile size\n"
-                               "\tn ... destination log2 image height\n"
-                               "\tm ... destination log2 image width\n"
+                               "\tn ... destination image height (log2 if < 32)\n"
+                               "\tm ... destination image width  (log2 if < 32)\n"
                                "\tp ... destination pixel size\n"
                                "\tx ... destination X (in pixels)\n"
                                "\ty ... destination Y (in pixels)\n"
                                "\tL ... source log2 tile size\n"
-                               "\tN ... source log2 image height\n"
-                               "\tM ... source log2 image width\n"
+                               "\tN ... source image height      (log2 if < 32)\n"
+                               "\tM ... source image width       (log2 if < 32)\n"
                                "\tP ... source pixel size\n"
                                "\tX ... source X      (in pixels)\n"
                                "\tY ... source Y      (in pixels)\n"
@@ -112,13 +303,13 @@ int main(int argc, char **argv)
 {
     bool ok = false;
     bool t  = false;
-    int  l  = 5;
+    int  l  = -1;
     int  n  = 0;
     int  m  = 0;
     int  p  = 0;
     int  x  = 0;
     int  y  = 0;
-    int  L  = 5;
+    int  L  = -1;
     int  N  = 0;
     int  M  = 0;
     int  P  = 0;
@@ -134,14 +325,14 @@ int main(int argc, char **argv)
         switch (o)
         {
             case 'l': l = (int) strtol(optarg, 0, 0); break;
-            case 'n': n = (int) strtol(optarg, 0, 0); break;
-            case 'm': m = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = imgdim(strtol(optarg, 0, 0)); break;
+            case 'm': m = imgdim(strtol(optarg, 0, 0)); break;
             case 'p': p = (int) strtol(optarg, 0, 0); break;
             case 'x': x = (int) strtol(optarg, 0, 0); break;
             case 'y': y = (int) strtol(optarg, 0, 0); break;
             case 'L': L = (int) strtol(optarg, 0, 0); break;
-            case 'N': N = (int) strtol(optarg, 0, 0); break;
-            case 'M': M = (int) strtol(optarg, 0, 0); break;
+            case 'N': N = imgdim(strtol(optarg, 0, 0)); break;
+            case 'M': M = imgdim(strtol(optarg, 0, 0)); break;
             case 'P': P = (int) strtol(optarg, 0, 0); break;
             case 'X': X = (int) strtol(optarg, 0, 0); break;
             case 'Y': Y = (int) strtol(optarg, 0, 0); break;
@@ -0,0 +1,556 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "err.h"
+#include "vec.h"
+
+//------------------------------------------------------------------------------
+
+// Determine the widest instruction set supported by the CPU.
+
+static int isadetect(void)
+{
+#ifdef GIGO_X86
+    if (__builtin_cpu_supports("avx512f"))
+        return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+                                       && __builtin_cpu_supports("f16c"))
+        return ISA_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ISA_SSE2;
+#endif
+    return ISA_SCALAR;
+}
+
+// Select the instruction set, honoring GIGO_ISA if it names one the CPU
+// supports.
+
+static int isainit(void)
+{
+    const char *name[] = { "scalar", "sse2", "avx2", "avx512" };
+    const char *e = getenv("GIGO_ISA");
+    const int   b = isadetect();
+
+    if (e)
+    {
+        for (int i = ISA_SCALAR; i <= ISA_AVX512; i++)
+            if (strcmp(e, name[i]) == 0)
+            {
+                if (i <= b)
+                    return i;
+
+                apperr("GIGO_ISA %s is not supported, using %s", e, name[b]);
+                return b;
+            }
+
+        apperr("GIGO_ISA %s is not recognized, using %s", e, name[b]);
+    }
+    return b;
+}
+
+// Return the selected instruction set, determining it on first use.
+
+int vecisa(void)
+{
+    static int isa = -1;
+
+    if (isa < 0)
+    {
+        #pragma omp critical (vecisa)
+        {
+            if (isa < 0)
+                isa = isainit();
+        }
+    }
+    return isa;
+}
+
+//------------------------------------------------------------------------------
+
+// Each kernel processes as many complex values as fill whole vectors and
+// returns that count. The scalar loop that follows handles any remainder and
+// serves as the fallback for all instruction sets.
+
+#ifdef GIGO_X86
+
+static TARGET_SSE2 size_t add128(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 2 <= n; i += 2)
+        _mm_storeu_ps(d + 2 * i, _mm_add_ps(_mm_loadu_ps(d + 2 * i),
+                                            _mm_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_AVX2 size_t add256(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm256_storeu_ps(d + 2 * i, _mm256_add_ps(_mm256_loadu_ps(d + 2 * i),
+                                                  _mm256_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_AVX512 size_t add512(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm512_storeu_ps(d + 2 * i, _mm512_add_ps(_mm512_loadu_ps(d + 2 * i),
+                                                  _mm512_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_SSE2 size_t sub128(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 2 <= n; i += 2)
+        _mm_storeu_ps(d + 2 * i, _mm_sub_ps(_mm_loadu_ps(d + 2 * i),
+                                            _mm_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_AVX2 size_t sub256(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm256_storeu_ps(d + 2 * i, _mm256_sub_ps(_mm256_loadu_ps(d + 2 * i),
+                                                  _mm256_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_AVX512 size_t sub512(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm512_storeu_ps(d + 2 * i, _mm512_sub_ps(_mm512_loadu_ps(d + 2 * i),
+                                                  _mm512_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_SSE2 size_t mul128(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 2 <= n; i += 2)
+        _mm_storeu_ps(d + 2 * i, cmul128(_mm_loadu_ps(d + 2 * i),
+                                         _mm_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_AVX2 size_t mul256(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm256_storeu_ps(d + 2 * i, cmul256(_mm256_loadu_ps(d + 2 * i),
+                                            _mm256_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+static TARGET_AVX512 size_t mul512(float *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm512_storeu_ps(d + 2 * i, cmul512(_mm512_loadu_ps(d + 2 * i),
+                                            _mm512_loadu_ps(s + 2 * i)));
+    return i;
+}
+
+// Division and Wiener deconvolution both multiply d by the conjugate of s and
+// divide by the squared magnitude of s plus a constant k.
+
+static TARGET_SSE2 size_t div128(float *d, const float *s, size_t n, float k)
+{
+    const __m128 c = _mm_set_ps(-0.f, 0.f, -0.f, 0.f);
+    const __m128 K = _mm_set1_ps(k);
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2)
+    {
+        const __m128 a = _mm_loadu_ps(s + 2 * i);
+        const __m128 b = _mm_mul_ps(a, a);
+        const __m128 m = _mm_add_ps(_mm_add_ps(b, _mm_shuffle_ps(b, b,
+                                               _MM_SHUFFLE(2, 3, 0, 1))), K);
+        const __m128 z = cmul128(_mm_loadu_ps(d + 2 * i), _mm_xor_ps(a, c));
+
+        _mm_storeu_ps(d + 2 * i, _mm_div_ps(z, m));
+    }
+    return i;
+}
+
+static TARGET_AVX2 size_t div256(float *d, const float *s, size_t n, float k)
+{
+    const __m256 c = _mm256_set_ps(-0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f);
+    const __m256 K = _mm256_set1_ps(k);
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        const __m256 a = _mm256_loadu_ps(s + 2 * i);
+        const __m256 b = _mm256_mul_ps(a, a);
+        const __m256 m = _mm256_add_ps(_mm256_add_ps(b, _mm256_permute_ps(b,
+                                       _MM_SHUFFLE(2, 3, 0, 1))), K);
+        const __m256 z = cmul256(_mm256_loadu_ps(d + 2 * i),
+                                 _mm256_xor_ps(a, c));
+
+        _mm256_storeu_ps(d + 2 * i, _mm256_div_ps(z, m));
+    }
+    return i;
+}
+
+static TARGET_AVX512 size_t div512(float *d, const float *s, size_t n, float k)
+{
+    const __m512 c = _mm512_set_ps(-0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f,
+                                   -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f);
+    const __m512 K = _mm512_set1_ps(k);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        const __m512 a = _mm512_loadu_ps(s + 2 * i);
+        const __m512 b = _mm512_mul_ps(a, a);
+        const __m512 m = _mm512_add_ps(_mm512_add_ps(b, _mm512_permute_ps(b,
+                                       _MM_SHUFFLE(2, 3, 0, 1))), K);
+        const __m512 z = cmul512(_mm512_loadu_ps(d + 2 * i), xor512(a, c));
+
+        _mm512_storeu_ps(d + 2 * i, _mm512_div_ps(z, m));
+    }
+    return i;
+}
+
+static TARGET_SSE2 size_t scale128(float *d, float k, size_t n)
+{
+    const __m128 K = _mm_set1_ps(k);
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2)
+        _mm_storeu_ps(d + 2 * i, _mm_mul_ps(_mm_loadu_ps(d + 2 * i), K));
+    return i;
+}
+
+static TARGET_AVX2 size_t scale256(float *d, float k, size_t n)
+{
+    const __m256 K = _mm256_set1_ps(k);
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm256_storeu_ps(d + 2 * i, _mm256_mul_ps(_mm256_loadu_ps(d + 2 * i), K));
+    return i;
+}
+
+static TARGET_AVX512 size_t scale512(float *d, float k, size_t n)
+{
+    const __m512 K = _mm512_set1_ps(k);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm512_storeu_ps(d + 2 * i, _mm512_mul_ps(_mm512_loadu_ps(d + 2 * i), K));
+    return i;
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+
+void vecadd(float complex *d, const float complex *s, size_t n)
+{
+    float       *D = (float       *) d;
+    const float *S = (const float *) s;
+    size_t       i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = add512(D, S, n); break;
+        case ISA_AVX2:   i = add256(D, S, n); break;
+        case ISA_SSE2:   i = add128(D, S, n); break;
+    }
+#endif
+    for (; i < n; i++)
+    {
+        D[2 * i + 0] += S[2 * i + 0];
+        D[2 * i + 1] += S[2 * i + 1];
+    }
+}
+
+void vecsub(float complex *d, const float complex *s, size_t n)
+{
+    float       *D = (float       *) d;
+    const float *S = (const float *) s;
+    size_t       i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = sub512(D, S, n); break;
+        case ISA_AVX2:   i = sub256(D, S, n); break;
+        case ISA_SSE2:   i = sub128(D, S, n); break;
+    }
+#endif
+    for (; i < n; i++)
+    {
+        D[2 * i + 0] -= S[2 * i + 0];
+        D[2 * i + 1] -= S[2 * i + 1];
+    }
+}
+
+void vecmul(float complex *d, const float complex *s, size_t n)
+{
+    float       *D = (float       *) d;
+    const float *S = (const float *) s;
+    size_t       i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = mul512(D, S, n); break;
+        case ISA_AVX2:   i = mul256(D, S, n); break;
+        case ISA_SSE2:   i = mul128(D, S, n); break;
+    }
+#endif
+    for (; i < n; i++)
+    {
+        const float dr = D[2 * i], di = D[2 * i + 1];
+        const float sr = S[2 * i], si = S[2 * i + 1];
+
+        D[2 * i + 0] = dr * sr - di * si;
+        D[2 * i + 1] = dr * si + di * sr;
+    }
+}
+
+// Compute d (s*) / (|s|^2 + k). With k = 0 this is plain division, without
+// the range scaling of C99 complex division.
+
+void vecwiener(float complex *d, const float complex *s, size_t n, float k)
+{
+    float       *D = (float       *) d;
+    const float *S = (const float *) s;
+    size_t       i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = div512(D, S, n, k); break;
+        case ISA_AVX2:   i = div256(D, S, n, k); break;
+        case ISA_SSE2:   i = div128(D, S, n, k); break;
+    }
+#endif
+    for (; i < n; i++)
+    {
+        const float dr = D[2 * i], di = D[2 * i + 1];
+        const float sr = S[2 * i], si = S[2 * i + 1];
+        const float m  = sr * sr + si * si + k;
+
+        D[2 * i + 0] = (dr * sr + di * si) / m;
+        D[2 * i + 1] = (di * sr - dr * si) / m;
+    }
+}
+
+void vecdiv(float complex *d, const float complex *s, size_t n)
+{
+    vecwiener(d, s, n, 0.f);
+}
+
+void vecscale(float complex *d, float k, size_t n)
+{
+    float *D = (float *) d;
+    size_t i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = scale512(D, k, n); break;
+        case ISA_AVX2:   i = scale256(D, k, n); break;
+        case ISA_SSE2:   i = scale128(D, k, n); break;
+    }
+#endif
+    for (; i < n; i++)
+    {
+        D[2 * i + 0] *= k;
+        D[2 * i + 1] *= k;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Half precision conversion uses F16C alongside AVX2, and AVX-512F directly.
+// Bfloat16 is the upper half of a float, so its conversion is integer shifts,
+// rounding by adding 0x7fff plus the parity of the surviving low bit. A NaN
+// is kept quiet, rather than allowed to round to infinity. SSE2 offers neither
+// a half conversion nor an unsigned 32-to-16 bit pack, so it takes the scalar
+// loop for both.
+
+#ifdef GIGO_X86
+
+static TARGET_AVX2 size_t htof256(float *d, const unsigned short *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(d + i, _mm256_cvtph_ps(
+                         _mm_loadu_si128((const __m128i *) (s + i))));
+    return i;
+}
+
+static TARGET_AVX512 size_t htof512(float *d, const unsigned short *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(d + i, _mm512_cvtph_ps(
+                         _mm256_loadu_si256((const __m256i *) (s + i))));
+    return i;
+}
+
+static TARGET_AVX2 size_t ftoh256(unsigned short *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i *) (d + i), _mm256_cvtps_ph(
+                         _mm256_loadu_ps(s + i), _MM_FROUND_TO_NEAREST_INT));
+    return i;
+}
+
+static TARGET_AVX512 size_t ftoh512(unsigned short *d, const float *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 16 <= n; i += 16)
+        _mm256_storeu_si256((__m256i *) (d + i), _mm512_cvtps_ph(
+                            _mm512_loadu_ps(s + i), _MM_FROUND_TO_NEAREST_INT));
+    return i;
+}
+
+static TARGET_AVX2 size_t btof256(float *d, const unsigned short *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        const __m256i b = _mm256_cvtepu16_epi32(
+                          _mm_loadu_si128((const __m128i *) (s + i)));
+
+        _mm256_storeu_si256((__m256i *) (d + i), _mm256_slli_epi32(b, 16));
+    }
+    return i;
+}
+
+static TARGET_AVX512 size_t btof512(float *d, const unsigned short *s, size_t n)
+{
+    size_t i;
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        const __m512i b = _mm512_cvtepu16_epi32(
+                          _mm256_loadu_si256((const __m256i *) (s + i)));
+
+        _mm512_storeu_si512(d + i, _mm512_slli_epi32(b, 16));
+    }
+    return i;
+}
+
+static TARGET_AVX2 size_t ftob256(unsigned short *d, const float *s, size_t n)
+{
+    const __m256i k = _mm256_set1_epi32(0x7fff);
+    const __m256i o = _mm256_set1_epi32(1);
+    const __m256i q = _mm256_set1_epi32(0x400000);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        const __m256  f = _mm256_loadu_ps(s + i);
+        const __m256i u = _mm256_castps_si256(f);
+        const __m256i r = _mm256_add_epi32(_mm256_add_epi32(u, k),
+                          _mm256_and_si256(_mm256_srli_epi32(u, 16), o));
+        const __m256i b = _mm256_blendv_epi8(r, _mm256_or_si256(u, q),
+                          _mm256_castps_si256(_mm256_cmp_ps(f, f, _CMP_UNORD_Q)));
+        const __m256i h = _mm256_srli_epi32(b, 16);
+
+        _mm_storeu_si128((__m128i *) (d + i), _mm256_castsi256_si128(
+                         _mm256_permute4x64_epi64(_mm256_packus_epi32(h, h),
+                                                  _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+    return i;
+}
+
+static TARGET_AVX512 size_t ftob512(unsigned short *d, const float *s, size_t n)
+{
+    const __m512i k = _mm512_set1_epi32(0x7fff);
+    const __m512i o = _mm512_set1_epi32(1);
+    const __m512i q = _mm512_set1_epi32(0x400000);
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        const __m512    f = _mm512_loadu_ps(s + i);
+        const __m512i   u = _mm512_castps_si512(f);
+        const __mmask16 m = _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q);
+        const __m512i   r = _mm512_add_epi32(_mm512_add_epi32(u, k),
+                            _mm512_and_si512(_mm512_srli_epi32(u, 16), o));
+        const __m512i   b = _mm512_mask_or_epi32(r, m, u, q);
+
+        _mm256_storeu_si256((__m256i *) (d + i),
+                            _mm512_cvtepi32_epi16(_mm512_srli_epi32(b, 16)));
+    }
+    return i;
+}
+
+#endif
+
+void vechtof(float *d, const unsigned short *s, size_t n)
+{
+    size_t i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = htof512(d, s, n); break;
+        case ISA_AVX2:   i = htof256(d, s, n); break;
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = htof(s[i]);
+}
+
+void vecftoh(unsigned short *d, const float *s, size_t n)
+{
+    size_t i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = ftoh512(d, s, n); break;
+        case ISA_AVX2:   i = ftoh256(d, s, n); break;
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = ftoh(s[i]);
+}
+
+void vecbtof(float *d, const unsigned short *s, size_t n)
+{
+    size_t i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = btof512(d, s, n); break;
+        case ISA_AVX2:   i = btof256(d, s, n); break;
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = btof(s[i]);
+}
+
+void vecftob(unsigned short *d, const float *s, size_t n)
+{
+    size_t i = 0;
+#ifdef GIGO_X86
+    switch (vecisa())
+    {
+        case ISA_AVX512: i = ftob512(d, s, n); break;
+        case ISA_AVX2:   i = ftob256(d, s, n); break;
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = ftob(s[i]);
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,173 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_VEC_H
+#define GIGO_VEC_H
+
+#include <complex.h>
+#include <stddef.h>
+
+//------------------------------------------------------------------------------
+
+// Instruction sets in increasing order of vector width. The best supported by
+// the CPU is selected at run time, or may be forced by setting the environment
+// variable GIGO_ISA to "scalar", "sse2", "avx2", or "avx512".
+
+enum
+{
+    ISA_SCALAR,
+    ISA_SSE2,
+    ISA_AVX2,
+    ISA_AVX512,
+};
+
+int vecisa(void);
+
+//------------------------------------------------------------------------------
+
+void vecadd   (float complex *d, const float complex *s, size_t n);
+void vecsub   (float complex *d, const float complex *s, size_t n);
+void vecmul   (float complex *d, const float complex *s, size_t n);
+void vecdiv   (float complex *d, const float complex *s, size_t n);
+void vecwiener(float complex *d, const float complex *s, size_t n, float k);
+void vecscale (float complex *d, float k, size_t n);
+
+//------------------------------------------------------------------------------
+
+// Convert n floats to and from IEEE half precision (h) and bfloat16 (b), both
+// rounding to nearest even.
+
+void vechtof(float *d, const unsigned short *s, size_t n);
+void vecftoh(unsigned short *d, const float *s, size_t n);
+void vecbtof(float *d, const unsigned short *s, size_t n);
+void vecftob(unsigned short *d, const float *s, size_t n);
+
+union vecbits
+{
+    unsigned int u;
+    float        f;
+};
+
+static inline float htof(unsigned short h)
+{
+    const unsigned int s = (h & 0x8000u) << 16;
+    const unsigned int e = (h >> 10) & 0x1fu;
+    const unsigned int m =  h & 0x3ffu;
+
+    union vecbits v;
+
+    if (e == 0x1f)
+        v.u = s | 0x7f800000u | (m << 13);
+    else if (e)
+        v.u = s | ((e + 112) << 23) | (m << 13);
+    else
+    {
+        v.f = (float) m * 0x1p-24f;
+        v.u = v.u | s;
+    }
+    return v.f;
+}
+
+// Subnormal halves are rounded by the FPU, by adding 0.5 to align the binary
+// point of the result with the bottom of the mantissa.
+
+static inline unsigned short ftoh(float f)
+{
+    union vecbits v = { .f = f };
+
+    const unsigned int s = (v.u >> 16) & 0x8000u;
+    const unsigned int a =  v.u & 0x7fffffffu;
+
+    if (a > 0x7f800000u)
+        return s | 0x7e00u | ((a >> 13) & 0x3ffu);
+    if (a >= 0x477ff000u)
+        return s | 0x7c00u;
+    if (a < 0x38800000u)
+    {
+        v.u  = a;
+        v.f += 0.5f;
+        return s | (v.u - 0x3f000000u);
+    }
+    return s | ((a - 0x38000000u + 0xfffu + ((a >> 13) & 1)) >> 13);
+}
+
+static inline float btof(unsigned short b)
+{
+    union vecbits v = { .u = (unsigned int) b << 16 };
+    return v.f;
+}
+
+static inline unsigned short ftob(float f)
+{
+    union vecbits v = { .f = f };
+
+    if ((v.u & 0x7fffffffu) > 0x7f800000u)
+        return (v.u >> 16) | 0x40u;
+    else
+        return (v.u + 0x7fffu + ((v.u >> 16) & 1)) >> 16;
+}
+
+//------------------------------------------------------------------------------
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GIGO_X86
+
+#include <immintrin.h>
+
+#define TARGET_SSE2   __attribute__((target("sse2")))
+#define TARGET_AVX2   __attribute__((target("avx2,fma,f16c")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+// Multiply interleaved complex values a and b. SSE2 lacks the duplicating
+// moves and the alternating add-subtract, so shuffle and negate instead.
+
+static inline TARGET_SSE2 __m128 cmul128(__m128 a, __m128 b)
+{
+    const __m128 n  = _mm_set_ps(0.f, -0.f, 0.f, -0.f);
+    const __m128 br = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128 bi = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+    const __m128 as = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+
+    return _mm_add_ps(_mm_mul_ps(a, br), _mm_xor_ps(_mm_mul_ps(as, bi), n));
+}
+
+static inline TARGET_AVX2 __m256 cmul256(__m256 a, __m256 b)
+{
+    const __m256 br = _mm256_moveldup_ps(b);
+    const __m256 bi = _mm256_movehdup_ps(b);
+    const __m256 as = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+
+    return _mm256_fmaddsub_ps(a, br, _mm256_mul_ps(as, bi));
+}
+
+static inline TARGET_AVX512 __m512 cmul512(__m512 a, __m512 b)
+{
+    const __m512 br = _mm512_moveldup_ps(b);
+    const __m512 bi = _mm512_movehdup_ps(b);
+    const __m512 as = _mm512_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+
+    return _mm512_fmaddsub_ps(a, br, _mm512_mul_ps(as, bi));
+}
+
+// AVX-512F lacks floating point XOR, so flip sign bits as integers.
+
+static inline TARGET_AVX512 __m512 xor512(__m512 a, __m512 b)
+{
+    return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a),
+                                                _mm512_castps_si512(b)));
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,185 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_WIN_H
+#define GIGO_WIN_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "etc.h"
+
+//------------------------------------------------------------------------------
+
+// Frequency-domain window functions, selected by the option letter of filter:
+// rectangle, triangle, Hann, normal, Gaussian, and Butterworth.
+
+static inline int range_rect(float r, float w, int m)
+{
+    return (int) ceil(r);
+}
+
+static inline int range_tri(float r, float w, int m)
+{
+    return (int) ceil(r + w / 2);
+}
+
+static inline int range_hann(float r, float w, int m)
+{
+    return (int) ceil(r + w / 2);
+}
+
+static inline int range_norm(float r, float w, int m)
+{
+    return m;
+}
+
+static inline int range_gauss(float r, float w, int m)
+{
+    return m;
+}
+
+static inline int range_butter(float r, float w, int m)
+{
+    return m;
+}
+
+static inline int range(int op, float r, float w, int m)
+{
+    switch (op)
+    {
+        case 'R': return range_rect  (r, w, m);
+        case 'T': return range_tri   (r, w, m);
+        case 'H': return range_hann  (r, w, m);
+        case 'g': return range_norm  (r, w, m);
+        case 'G': return range_gauss (r, w, m);
+        case 'B': return range_butter(r, w, m);
+    }
+    return (int) r;
+}
+
+//------------------------------------------------------------------------------
+
+static inline float filter_rect(float k, float r, float w)
+{
+    return (k > r) ? 0.f : 1.f;
+}
+
+static inline float filter_tri(float k, float r, float w)
+{
+    if (k > r + w / 2) return 0.f;
+    if (k < r - w / 2) return 1.f;
+    return 0.5f - k / w + r / w;
+}
+
+static inline float filter_hann(float k, float r, float w)
+{
+    return 0.5f - cosf(M_PI * filter_tri(k, r, w)) / 2.f;
+}
+
+static inline float filter_norm(float k, float r, float w)
+{
+    const float a =  1.f / (2.f * M_PI * r * r);
+    const float b = -1.f / (2.f        * r * r);
+    return a * expf(b * k * k);
+}
+
+static inline float filter_gauss(float k, float r, float w)
+{
+    return expf(-0.5f * (k * k) / (r * r));
+}
+
+static inline float filter_butter(float k, float r, float w)
+{
+    return 1.f / (1.f + powf(k / r, 2 * w));
+}
+
+static inline float filter(int op, float k, float r, float w)
+{
+    switch (op)
+    {
+        case 'R': return filter_rect  (k, r, w);
+        case 'T': return filter_tri   (k, r, w);
+        case 'H': return filter_hann  (k, r, w);
+        case 'g': return filter_norm  (k, r, w);
+        case 'G': return filter_gauss (k, r, w);
+        case 'B': return filter_butter(k, r, w);
+    }
+    return 1.f;
+}
+
+//------------------------------------------------------------------------------
+
+static inline float dist(int i, int j, int y, int x, float a)
+{
+    const float di = (i - y);
+    const float dj = (j - x);
+
+    return sqrtf(di * di + dj * dj * a * a);
+}
+
+//------------------------------------------------------------------------------
+
+// A window centered at (y, x) of an N by M spectrum, bounded by a box of n by m
+// pixels of aspect a, and optionally inverted.
+
+struct win
+{
+    int   op;
+    bool  inv;
+    int   x;
+    int   y;
+    float r;
+    float w;
+    int   n;
+    int   m;
+    float a;
+};
+
+static inline void winset(struct win *f, int op, bool inv, int x, int y,
+                          float r, float w, int N, int M)
+{
+    f->op  = op;
+    f->inv = inv;
+    f->x   = x;
+    f->y   = y;
+    f->r   = r;
+    f->w   = w;
+    f->n   = range(op, r, w, N);
+
+    if (op == 'g')
+        f->m = f->n;
+    else
+        f->m = (int) ((long long) f->n * M / N);
+
+    f->a = (float) f->n / (float) f->m;
+}
+
+// Give the window value at pixel (i, j). Anything outside the bounding box is
+// zero, or one if the window is inverted.
+
+static inline float winval(const struct win *f, int i, int j)
+{
+    if (abs(i - f->y) > f->n || abs(j - f->x) > f->m)
+        return f->inv ? 1.f : 0.f;
+    else
+    {
+        const float t = filter(f->op, dist(i, j, f->y, f->x, f->a), f->r, f->w);
+
+        return f->inv ? 1.f - t : t;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+#endif
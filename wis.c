@@ -0,0 +1,167 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "img.h"
+#include "wis.h"
+
+//------------------------------------------------------------------------------
+
+// One line of the wisdom file: the key n, m, p, and processor count c, and
+// the tile size l, FFT variant s, and thread count t. Image sizes are written
+// as on the command line, as log2 for powers of two.
+
+struct wis
+{
+    int n, m, p, c;
+    int l, s, t;
+};
+
+typedef struct wis wis;
+
+static const char *wisname(char *buf, size_t len)
+{
+    const char *name;
+
+    if ((name = getenv("GIGO_WISDOM")))
+        return name;
+
+    if ((name = getenv("HOME")))
+    {
+        snprintf(buf, len, "%s/.gigo-wisdom", name);
+        return buf;
+    }
+    return NULL;
+}
+
+static int wiscpus(void)
+{
+    return (int) sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+static bool wisscan(FILE *fp, wis *w)
+{
+    char line[256];
+
+    while (fgets(line, sizeof (line), fp))
+        if (sscanf(line, "%d %d %d %d %d %d %d", &w->n, &w->m, &w->p, &w->c,
+                                                 &w->l, &w->s, &w->t) == 7)
+            return true;
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+// Look up the wisdom for an image on this machine. Leave the outputs untouched
+// and return false if there is none. Any output pointer may be null.
+
+bool wisget(int n, int m, int p, int *l, int *s, int *t)
+{
+    const int c = wiscpus();
+
+    n = imgarg(n);
+    m = imgarg(m);
+
+    char  buf[FILENAME_MAX];
+    const char *name;
+    FILE *fp;
+    wis   w;
+
+    bool ok = false;
+
+    if ((name = wisname(buf, sizeof (buf))) && (fp = fopen(name, "r")))
+    {
+        while (!ok && wisscan(fp, &w))
+            if (w.n == n && w.m == m && w.p == p && w.c == c)
+            {
+                if (l) *l = w.l;
+                if (s) *s = w.s;
+                if (t) *t = w.t;
+                ok = true;
+            }
+        fclose(fp);
+    }
+    return ok;
+}
+
+// Record the wisdom for an image on this machine, replacing any prior entry.
+// Rewrite the file in full and rename it into place, so that concurrent readers
+// never see a partial file.
+
+bool wisput(int n, int m, int p, int l, int s, int t)
+{
+    const int c = wiscpus();
+
+    n = imgarg(n);
+    m = imgarg(m);
+
+    char  buf[FILENAME_MAX];
+    char  tmp[FILENAME_MAX + 16];
+    const char *name;
+    FILE *fp;
+    FILE *fq;
+    wis   w;
+
+    bool ok = false;
+
+    if ((name = wisname(buf, sizeof (buf))))
+    {
+        snprintf(tmp, sizeof (tmp), "%s.%d", name, (int) getpid());
+
+        if ((fq = fopen(tmp, "w")))
+        {
+            fprintf(fq, "# n m p cpus l sort threads\n");
+
+            if ((fp = fopen(name, "r")))
+            {
+                while (wisscan(fp, &w))
+                    if (w.n != n || w.m != m || w.p != p || w.c != c)
+                        fprintf(fq, "%d %d %d %d %d %d %d\n", w.n, w.m, w.p,
+                                                              w.c, w.l, w.s,
+                                                              w.t);
+                fclose(fp);
+            }
+            fprintf(fq, "%d %d %d %d %d %d %d\n", n, m, p, c, l, s, t);
+
+            if (fclose(fq) == 0 && rename(tmp, name) == 0)
+                ok = true;
+            else
+            {
+                syserr("Failed to write wisdom %s", name);
+                remove(tmp);
+            }
+        }
+        else syserr("Failed to open wisdom %s", tmp);
+    }
+    else apperr("No wisdom file name: set GIGO_WISDOM or HOME");
+
+    return ok;
+}
+
+// Return the tile size for an image, from wisdom if available. Otherwise use
+// the long-standing default.
+
+int wistile(int n, int m, int p)
+{
+    int l = 5;
+
+    wisget(n, m, p, &l, NULL, NULL);
+
+    return l;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,32 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_WIS_H
+#define GIGO_WIS_H
+
+#include <stdbool.h>
+
+//------------------------------------------------------------------------------
+
+// Wisdom records the fastest tile size, FFT variant, and thread count found by
+// the planner for an image of a given size on a machine with a given number of
+// processors. It lives in the file named by the GIGO_WISDOM environment
+// variable, or in ~/.gigo-wisdom by default.
+
+bool wisget(int n, int m, int p, int *l, int *s, int *t);
+bool wisput(int n, int m, int p, int  l, int  s, int  t);
+
+int  wistile(int n, int m, int p);
+
+//------------------------------------------------------------------------------
+
+#endif
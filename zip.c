@@ -0,0 +1,308 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include <sys/stat.h>
+
+#include "err.h"
+#include "zip.h"
+
+//------------------------------------------------------------------------------
+
+// Each table entry gives the offset and length of a block, and the capacity of
+// the space allotted to it. A block of length F is stored verbatim, as its
+// frame did not compress. A block of capacity zero is shared by several frames
+// and so may not be rewritten in place.
+
+struct zipent
+{
+    uint64_t o;  // block offset
+    uint32_t n;  // block length
+    uint32_t c;  // block capacity
+};
+
+struct zip
+{
+    int            f;  // image file descriptor
+    off_t          o;  // table offset
+    size_t         K;  // frame count
+    size_t         F;  // frame size
+    size_t         e;  // sample element size
+    off_t          end;// end of file
+    struct zipent *t;  // table
+};
+
+size_t ziptable(size_t K)
+{
+    return K * sizeof (struct zipent);
+}
+
+//------------------------------------------------------------------------------
+
+// Frames are coded by whichever thread pages them, often within the fault
+// handler of the pool, so each thread keeps its own streams and buffers.
+
+static __thread z_stream def;
+static __thread z_stream inf;
+static __thread bool     defok;
+static __thread bool     infok;
+static __thread char    *tmp;
+static __thread size_t   tmplen;
+
+static char *scratch(size_t len)
+{
+    if (tmplen < len)
+    {
+        free(tmp);
+
+        if ((tmp = (char *) malloc(len)))
+            tmplen = len;
+        else
+            tmplen = 0;
+    }
+    return tmp;
+}
+
+// Gather byte b of each of the F / e elements of a frame into plane b, as the
+// exponent bytes of neighboring samples are much alike while the low mantissa
+// bytes are noise. Spread the planes back out again.
+
+static void shuffle(char *dst, const char *src, size_t F, size_t e)
+{
+    const size_t n = F / e;
+
+    for     (size_t b = 0; b < e; b++)
+        for (size_t i = 0; i < n; i++)
+            dst[b * n + i] = src[i * e + b];
+}
+
+static void unshuffle(char *dst, const char *src, size_t F, size_t e)
+{
+    const size_t n = F / e;
+
+    for     (size_t b = 0; b < e; b++)
+        for (size_t i = 0; i < n; i++)
+            dst[i * e + b] = src[b * n + i];
+}
+
+// Encode frame buf into dst, which holds F bytes, and return the length. If the
+// frame does not compress, store it verbatim.
+
+static size_t encode(char *dst, const void *buf, size_t F, size_t e, char *s)
+{
+    if (!defok)
+        defok = (deflateInit(&def, Z_BEST_SPEED) == Z_OK);
+
+    if (defok && deflateReset(&def) == Z_OK)
+    {
+        shuffle(s, (const char *) buf, F, e);
+
+        def.next_in   = (Bytef *) s;
+        def.avail_in  = (uInt)    F;
+        def.next_out  = (Bytef *) dst;
+        def.avail_out = (uInt)   (F - 1);
+
+        if (deflate(&def, Z_FINISH) == Z_STREAM_END)
+            return F - 1 - def.avail_out;
+    }
+    memcpy(dst, buf, F);
+    return F;
+}
+
+// Decode a block of length n from src into frame buf.
+
+static bool decode(void *buf, const char *src, size_t n, size_t F, size_t e,
+                                                                   char *s)
+{
+    if (n == F)
+    {
+        memcpy(buf, src, F);
+        return true;
+    }
+    if (!infok)
+        infok = (inflateInit(&inf) == Z_OK);
+
+    if (infok && inflateReset(&inf) == Z_OK)
+    {
+        inf.next_in   = (Bytef *) src;
+        inf.avail_in  = (uInt)    n;
+        inf.next_out  = (Bytef *) s;
+        inf.avail_out = (uInt)    F;
+
+        if (inflate(&inf, Z_FINISH) == Z_STREAM_END && inf.avail_out == 0)
+        {
+            unshuffle((char *) buf, s, F, e);
+            return true;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+static bool xfer(int f, char *buf, size_t len, off_t o, bool out)
+{
+    while (len > 0)
+    {
+        ssize_t n = out ? pwrite(f, buf, len, o)
+                        : pread (f, buf, len, o);
+        if (n > 0)
+        {
+            buf += n;
+            len -= n;
+            o   += n;
+        }
+        else return false;
+    }
+    return true;
+}
+
+// Write the table of a new compressed image, with every frame sharing a single
+// block at offset d holding the F bytes of buf.
+
+bool zipinit(int f, off_t o, size_t K, size_t F, size_t e, off_t d,
+                                                        const void *buf)
+{
+    struct zipent *t;
+    char          *b;
+    bool           ok = false;
+
+    if ((t = (struct zipent *) malloc(ziptable(K))) &&
+        (b = (char *) malloc(2 * F)))
+    {
+        const size_t n = encode(b, buf, F, e, b + F);
+
+        for (size_t k = 0; k < K; k++)
+        {
+            t[k].o = (uint64_t) d;
+            t[k].n = (uint32_t) n;
+            t[k].c = 0;
+        }
+        ok = xfer(f, b,          n,          d, true)
+          && xfer(f, (char *) t, ziptable(K), o, true);
+
+        free(b);
+    }
+    free(t);
+    return ok;
+}
+
+// Read the table of a compressed image. New blocks go at the end of the file,
+// beyond any space allotted to the blocks already there, which the file may not
+// yet reach.
+
+struct zip *zipopen(int f, off_t o, size_t K, size_t F, size_t e)
+{
+    struct zip *z;
+    struct stat s;
+
+    if ((z = (struct zip *) calloc(1, sizeof (struct zip))))
+    {
+        if ((z->t = (struct zipent *) malloc(ziptable(K))))
+        {
+            if (fstat(f, &s) == 0 && xfer(f, (char *) z->t, ziptable(K), o, false))
+            {
+                z->f   = f;
+                z->o   = o;
+                z->K   = K;
+                z->F   = F;
+                z->e   = e;
+                z->end = s.st_size;
+
+                for (size_t k = 0; k < K; k++)
+                    if (z->end < (off_t) (z->t[k].o + z->t[k].c))
+                        z->end = (off_t) (z->t[k].o + z->t[k].c);
+
+                return z;
+            }
+            else syserr("Failed to read compressed image table");
+
+            free(z->t);
+        }
+        free(z);
+    }
+    return NULL;
+}
+
+// Transfer frame k between buffer and file, as a pool transfer function. Only
+// one thread at a time pages any given frame, so its entry needs no lock. A
+// block that outgrows its space moves to the end of the file, allotted a
+// little more than it needs so that it may grow in place next time.
+
+bool zipio(void *p, size_t k, void *buf, size_t len, bool out)
+{
+    struct zip    *z = (struct zip *) p;
+    struct zipent *t = z->t + k;
+    char          *b;
+
+    if (!(b = scratch(2 * z->F)))
+        return false;
+
+    if (out)
+    {
+        const size_t n = encode(b, buf, z->F, z->e, b + z->F);
+
+        if (n > t->c)
+        {
+            const size_t c = (n + n / 8 + 63) & ~(size_t) 63;
+
+            t->o = (uint64_t) __sync_fetch_and_add(&z->end, (off_t) c);
+            t->c = (uint32_t) c;
+        }
+        t->n = (uint32_t) n;
+
+        return xfer(z->f, b, n, (off_t) t->o, true);
+    }
+    else
+    {
+        if (t->n == 0)
+        {
+            memset(buf, 0, len);
+            return true;
+        }
+        return xfer(z->f, b + z->F, t->n, (off_t) t->o, false)
+            && decode(buf, b + z->F, t->n, z->F, z->e, b);
+    }
+}
+
+// Begin reading the blocks of the frames spanning bytes a through b of the
+// samples into the page cache.
+
+void zipfetch(struct zip *z, size_t a, size_t b)
+{
+    for (size_t k = a / z->F; k < z->K && k * z->F < b; k++)
+        posix_fadvise(z->f, (off_t) z->t[k].o, (off_t) z->t[k].n,
+                                               POSIX_FADV_WILLNEED);
+}
+
+// Write back the table and release the compressed image.
+
+bool zipclose(struct zip *z)
+{
+    const bool ok = xfer(z->f, (char *) z->t, ziptable(z->K), z->o, true);
+
+    if (!ok) syserr("Failed to write compressed image table");
+
+    free(z->t);
+    free(z);
+
+    return ok;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,46 @@
+// GIGO Copyright (C) 2012 Robert Kooima
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef GIGO_ZIP_H
+#define GIGO_ZIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+//------------------------------------------------------------------------------
+
+// A compressed image cache stores each frame of F bytes of samples as a block,
+// byte-shuffled by sample element size and deflated. A table of K entries at
+// file offset o locates the block of each frame. Blocks are rewritten in place
+// where they fit and appended to the file where they do not. Frames move
+// through a buffer pool, with zipio as its transfer function.
+
+enum
+{
+    ZIP_NONE = 0,
+    ZIP_ZLIB = 1,
+};
+
+struct zip;
+
+size_t      ziptable(size_t K);
+bool        zipinit (int f, off_t o, size_t K, size_t F, size_t e, off_t d,
+                                                         const void *buf);
+struct zip *zipopen (int f, off_t o, size_t K, size_t F, size_t e);
+bool        zipio   (void *p, size_t k, void *buf, size_t len, bool out);
+void        zipfetch(struct zip *z, size_t a, size_t b);
+bool        zipclose(struct zip *z);
+
+//------------------------------------------------------------------------------
+
+#endif